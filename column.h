@@ -0,0 +1,158 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+#include <stddef.h>
+
+// An array which either owns its elements or views elements mapped from
+// a file. A mapped column is read-only, detach() copies the elements so
+// they can be changed.
+template <typename T>
+class Column
+{
+public:
+    Column() : m_data(nullptr), m_size(0), m_mapped(false) {}
+
+    Column(const Column &other)
+        : m_owned(other.m_owned)
+        , m_data(other.m_data)
+        , m_size(other.m_size)
+        , m_mapped(other.m_mapped)
+    {
+        sync();
+    }
+
+    Column &operator=(const Column &other)
+    {
+        m_owned = other.m_owned;
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_mapped = other.m_mapped;
+        sync();
+        return *this;
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    bool isMapped() const { return m_mapped; }
+
+    const T *data() const { return m_data; }
+    const T *begin() const { return m_data; }
+    const T *end() const { return m_data + m_size; }
+    const T &back() const { assert(m_size > 0); return m_data[m_size - 1]; }
+    const T &operator[](size_t i) const { assert(i < m_size); return m_data[i]; }
+
+    // every read goes through the const operator[], so a mapped column
+    // cannot be written by accident
+    T &ref(size_t i)
+    {
+        assert(!m_mapped && i < m_size);
+        return m_owned[i];
+    }
+
+    void push_back(const T &value)
+    {
+        assert(!m_mapped);
+        m_owned.push_back(value);
+        sync();
+    }
+
+    void append(const T *first, const T *last)
+    {
+        assert(!m_mapped);
+        m_owned.insert(m_owned.end(), first, last);
+        sync();
+    }
+
+    void resize(size_t size, const T &value)
+    {
+        assert(!m_mapped);
+        m_owned.resize(size, value);
+        sync();
+    }
+
+    void assign(size_t size, const T &value)
+    {
+        assert(!m_mapped);
+        m_owned.assign(size, value);
+        sync();
+    }
+
+    void clear()
+    {
+        m_owned.clear();
+        m_mapped = false;
+        sync();
+    }
+
+    // data must stay valid until the column is cleared or detached
+    void map(const void *data, size_t size)
+    {
+        m_owned.clear();
+        m_owned.shrink_to_fit();
+        m_data = static_cast<const T *>(data);
+        m_size = size;
+        m_mapped = true;
+    }
+
+    void swap(Column &other)
+    {
+        // the buffers move with the vectors, so m_data stays valid
+        m_owned.swap(other.m_owned);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_mapped, other.m_mapped);
+    }
+
+    void detach()
+    {
+        if (m_mapped)
+        {
+            m_owned.assign(m_data, m_data + m_size);
+            m_mapped = false;
+            sync();
+        }
+    }
+
+private:
+    void sync()
+    {
+        if (!m_mapped)
+        {
+            m_data = m_owned.data();
+            m_size = m_owned.size();
+        }
+    }
+
+private:
+    std::vector<T> m_owned;
+    const T *m_data;
+    size_t m_size;
+    bool m_mapped;
+};
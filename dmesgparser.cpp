@@ -23,100 +23,824 @@
  ********************************************************************************/
 
 #include "dmesgparser.h"
+#include "logmerger.h"
 
-#include <QStringList>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <limits>
+
+#include <string.h>
+
+namespace
+{
+
+struct Field
+{
+    const char *begin;
+    const char *end;
+};
+
+// split [begin, end) by '|' like QString::split, but only the first
+// maxCount fields are located and nothing is copied
+int splitFields(const char *begin, const char *end, Field *fields, int maxCount)
+{
+    int count = 0;
+    const char *p = begin;
+    while (count < maxCount)
+    {
+        const char *sep = static_cast<const char *>(memchr(p, '|', static_cast<size_t>(end - p)));
+        fields[count].begin = p;
+        fields[count].end = sep ? sep : end;
+        count++;
+
+        if (!sep)
+        {
+            break;
+        }
+        p = sep + 1;
+    }
+    return count;
+}
+
+// same as QString::toInt(): the whole field must be a decimal number
+bool fieldToInt(const Field &f, int &value)
+{
+    const char *p = f.begin;
+    bool negative = false;
+    if (p < f.end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    if (p == f.end)
+    {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (; p < f.end; p++)
+    {
+        if (*p < '0' || *p > '9')
+        {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+        // -2147483648 fits, 2147483648 does not
+        if (result > static_cast<int64_t>(std::numeric_limits<int>::max()) + negative)
+        {
+            return false;
+        }
+    }
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+int fieldToIntOrZero(const Field &f)
+{
+    int value = 0;
+    return fieldToInt(f, value) ? value : 0;
+}
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// "    4.070211" -> 4070211 (microsecond)
+bool parseTime(const char *begin, const char *end, int64_t &time)
+{
+    while (begin < end && isSpace(*begin))
+    {
+        begin++;
+    }
+    while (end > begin && isSpace(*(end - 1)))
+    {
+        end--;
+    }
+    if (begin == end)
+    {
+        return false;
+    }
+
+    const char *p = begin;
+    int64_t second = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        second = second * 10 + (*p - '0');
+    }
+
+    int64_t microsecond = 0;
+    if (p < end && *p == '.')
+    {
+        p++;
+        int64_t scale = 100000;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            microsecond += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    if (p != end)
+    {
+        return false;
+    }
+
+    time = second * 1000000 + microsecond;
+    return true;
+}
+
+bool startsWith(const char *begin, const char *end, const char *prefix, size_t prefixSize)
+{
+    return static_cast<size_t>(end - begin) >= prefixSize && memcmp(begin, prefix, prefixSize) == 0;
+}
+
+const char *findLineEnd(const char *p, const char *end)
+{
+    const char *eol = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    return eol ? eol : end;
+}
+
+// bytes tokenized by one worker at a time, a window is threadCount chunks
+const qint64 CHUNK_SIZE = 8 * 1024 * 1024;
+
+// a kernel log line is rarely shorter than this
+const qint64 MIN_LINE_SIZE = 32;
+
+// bytes parsed between two progress reports
+const qint64 PROGRESS_INTERVAL = 4 * 1024 * 1024;
+// the same for merged files, whose bytes are counted compressed
+const int PROGRESS_EVENTS = 64 * 1024;
+
+// printk of several CPUs may swap lines a little, so a time window is
+// read on this long after its end
+const int64_t REORDER_SLACK = 1000000;
+
+struct Chunk
+{
+    const char *begin;
+    const char *end;
+    std::vector<DmesgEvent> events;
+    int malformed;
+    // index entries are offsets from base, none are made without one
+    const char *base;
+    LogIndex index;
+};
+
+void tokenizeChunk(Chunk &chunk)
+{
+    chunk.events.clear();
+    chunk.events.reserve(static_cast<size_t>((chunk.end - chunk.begin) / MIN_LINE_SIZE));
+    chunk.malformed = 0;
+    chunk.index.clear();
+
+    const char *p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char *lineEnd = findLineEnd(p, chunk.end);
+
+        DmesgEvent event;
+        if (DmesgParser::tokenizeLine(p, lineEnd, event, &chunk.malformed))
+        {
+            chunk.events.push_back(event);
+            if (chunk.base)
+            {
+                chunk.index.addEvent(event.time, p - chunk.base);
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+// split [p, end) into at most count chunks which never break a line
+const char *splitChunks(const char *p, const char *end, const char *base, QVector<Chunk> &chunks, int count)
+{
+    chunks.clear();
+    for (int i = 0; i < count && p < end; i++)
+    {
+        const char *chunkEnd = end;
+        if (end - p > CHUNK_SIZE)
+        {
+            chunkEnd = findLineEnd(p + CHUNK_SIZE, end);
+            if (chunkEnd < end)
+            {
+                chunkEnd++;
+            }
+        }
+
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = chunkEnd;
+        chunk.base = base;
+        chunks.append(chunk);
+
+        p = chunkEnd;
+    }
+    return p;
+}
+
+}
 
 DmesgParser::DmesgParser(TaskModel &model)
     : m_model(model)
+    , m_threadCount(QThread::idealThreadCount())
+    , m_indexEnabled(false)
+    , m_index(nullptr)
+    , m_cancelled(false)
+    , m_malformedCount(0)
 {
 
 }
 
 void DmesgParser::parse(const QString &dmesg)
 {
+    const QByteArray bytes = dmesg.toUtf8();
+    parseBytes(bytes.constData(), bytes.size());
+}
+
+bool DmesgParser::parseFile(const QString &path)
+{
+    const QFileInfo info(path);
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    if (size == 0)
+    {
+        parseBytes(nullptr, 0);
+        return true;
+    }
+
+    const uchar *data = file.map(0, size);
+    if (!data)
+    {
+        // e.g. a pipe or procfs file, fall back to reading it
+        qDebug() << "map failed, read instead:" << file.errorString();
+        const QByteArray bytes = file.readAll();
+        parseBytes(bytes.constData(), bytes.size());
+        return !m_cancelled;
+    }
+
+    LogIndex index;
+    m_index = m_indexEnabled ? &index : nullptr;
+    parseBytes(reinterpret_cast<const char *>(data), size);
+    file.unmap(const_cast<uchar *>(data));
+
+    if (m_index)
+    {
+        m_index = nullptr;
+        if (!m_cancelled)
+        {
+            index.save(info);
+        }
+    }
+    return !m_cancelled;
+}
+
+bool DmesgParser::parseFileLines(const QString &path, qint64 &size)
+{
+    size = 0;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+
+    // stick to what the file holds now, the rest is appended later
+    qint64 available = file.size();
+    const uchar *data = available > 0 ? file.map(0, available) : nullptr;
+    QByteArray bytes;
+    const char *begin = reinterpret_cast<const char *>(data);
+    if (!data)
+    {
+        bytes = file.read(available);
+        begin = bytes.constData();
+        available = bytes.size();
+    }
+
+    // the last line may be half written
+    const char *end = begin + available;
+    while (end > begin && *(end - 1) != '\n')
+    {
+        end--;
+    }
+    size = end - begin;
+
+    parseBytes(begin, size);
+    if (data)
+    {
+        file.unmap(const_cast<uchar *>(data));
+    }
+    return !m_cancelled;
+}
+
+bool DmesgParser::parseFileFrom(const QString &path, int64_t time)
+{
+    return parseFileSeek(path, time, -1, false);
+}
+
+bool DmesgParser::parseFileWindow(const QString &path, int64_t begin, int64_t end)
+{
+    return parseFileSeek(path, begin, end, true);
+}
+
+bool DmesgParser::parseFileSeek(const QString &path, int64_t begin, int64_t end, bool window)
+{
+    const QFileInfo info(path);
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data)
+    {
+        if (!window)
+        {
+            file.close();
+            return parseFile(path);
+        }
+        const QByteArray bytes = file.readAll();
+        parseWindow(bytes.constData(), bytes.size(), begin, end);
+        return !m_cancelled;
+    }
+
+    // only the pages from the offset on are read when the index is fresh
+    const char *bytes = reinterpret_cast<const char *>(data);
+    LogIndex index;
+    if (!index.load(path))
+    {
+        // a scan of the file, kept only with indexEnabled()
+        index.build(bytes, size);
+        if (m_indexEnabled)
+        {
+            index.save(info);
+        }
+    }
+
+    const int64_t offset = index.seek(begin);
+    if (window)
+    {
+        parseWindow(bytes + offset, size - offset, begin, end);
+    }
+    else
+    {
+        parseBytes(bytes + offset, size - offset);
+    }
+    file.unmap(const_cast<uchar *>(data));
+    return !m_cancelled;
+}
+
+bool DmesgParser::parseFiles(const QStringList &paths)
+{
+    LogMerger merger;
+    if (!merger.open(paths))
+    {
+        return false;
+    }
+
+    m_cancelled = false;
+    m_model.clear();
+
+    const qint64 total = merger.size();
+    DmesgEvent event;
+    for (int n = 1; merger.next(event); n++)
+    {
+        applyEvent(event);
+        if (n % PROGRESS_EVENTS == 0 && !reportProgress(merger.position(), total))
+        {
+            break;
+        }
+    }
+    m_malformedCount += merger.malformedLines();
+    reportMalformed();
+    m_model.finalize();
+    return !m_cancelled;
+}
+
+void DmesgParser::parseWindow(const char *data, qint64 size, int64_t begin, int64_t end)
+{
+    // a window is small, so it is not worth the worker threads
+    m_cancelled = false;
     m_model.clear();
 
-    QStringList list = dmesg.split('\n');
-    for (QString &s : list)
+    const char *p = data;
+    const char *dataEnd = data + size;
+    const char *nextReport = p + PROGRESS_INTERVAL;
+    while (p < dataEnd)
+    {
+        if (p >= nextReport)
+        {
+            if (!reportProgress(p - data, size))
+            {
+                break;
+            }
+            nextReport = p + PROGRESS_INTERVAL;
+        }
+
+        const char *lineEnd = findLineEnd(p, dataEnd);
+
+        DmesgEvent event;
+        if (tokenizeLine(p, lineEnd, event, &m_malformedCount))
+        {
+            if (event.time > end + REORDER_SLACK)
+            {
+                break;
+            }
+            if (event.time >= begin && event.time <= end)
+            {
+                applyWindowEvent(event, p, lineEnd, begin);
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+
+    m_model.clampLivingTasks(end);
+    reportMalformed();
+    m_model.finalize();
+}
+
+bool DmesgParser::indexEnabled() const
+{
+    return m_indexEnabled;
+}
+
+void DmesgParser::setIndexEnabled(bool enabled)
+{
+    m_indexEnabled = enabled;
+}
+
+void DmesgParser::setProgressCallback(const ProgressCallback &callback)
+{
+    m_progress = callback;
+}
+
+bool DmesgParser::cancelled() const
+{
+    return m_cancelled;
+}
+
+void DmesgParser::reportMalformed()
+{
+    if (m_malformedCount)
+    {
+        qDebug() << "malformed lines skipped:" << m_malformedCount;
+        m_malformedCount = 0;
+    }
+}
+
+bool DmesgParser::reportProgress(qint64 done, qint64 total)
+{
+    if (m_progress && !m_progress(done, total))
+    {
+        m_cancelled = true;
+    }
+    return !m_cancelled;
+}
+
+void DmesgParser::parseBytes(const char *data, qint64 size)
+{
+    m_model.clear();
+    appendBytes(data, size);
+}
+
+void DmesgParser::appendBytes(const char *data, qint64 size)
+{
+    m_cancelled = false;
+    if (m_threadCount > 1 && size > CHUNK_SIZE)
+    {
+        parseParallel(data, size);
+    }
+    else
+    {
+        parseSequential(data, size);
+    }
+    reportMalformed();
+    m_model.finalize();
+}
+
+int DmesgParser::threadCount() const
+{
+    return m_threadCount;
+}
+
+void DmesgParser::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(1, threadCount);
+}
+
+void DmesgParser::parseSequential(const char *data, qint64 size)
+{
+    const char *p = data;
+    const char *end = data + size;
+    const char *nextReport = p + PROGRESS_INTERVAL;
+    while (p < end)
+    {
+        if (p >= nextReport)
+        {
+            if (!reportProgress(p - data, size))
+            {
+                return;
+            }
+            nextReport = p + PROGRESS_INTERVAL;
+        }
+
+        const char *lineEnd = findLineEnd(p, end);
+
+        DmesgEvent event;
+        if (tokenizeLine(p, lineEnd, event, &m_malformedCount))
+        {
+            applyEvent(event);
+            if (m_index)
+            {
+                m_index->addEvent(event.time, p - data);
+            }
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+void DmesgParser::parseParallel(const char *data, qint64 size)
+{
+    // Workers tokenize the next window while this thread applies the
+    // current one to the model, so the pid -> id resolution, which must
+    // stay in file order, overlaps with the tokenizing.
+    const char *p = data;
+    const char *end = data + size;
+    const char *base = m_index ? data : nullptr;
+
+    QVector<Chunk> current;
+    QVector<Chunk> next;
+
+    p = splitChunks(p, end, base, current, m_threadCount);
+    QFuture<void> future = QtConcurrent::map(current, tokenizeChunk);
+
+    while (!current.isEmpty())
     {
-        parseOneLine(s);
+        future.waitForFinished();
+
+        p = splitChunks(p, end, base, next, m_threadCount);
+        QFuture<void> nextFuture;
+        if (!next.isEmpty())
+        {
+            nextFuture = QtConcurrent::map(next, tokenizeChunk);
+        }
+
+        for (const Chunk &chunk : current)
+        {
+            for (const DmesgEvent &event : chunk.events)
+            {
+                applyEvent(event);
+            }
+            m_malformedCount += chunk.malformed;
+            if (m_index)
+            {
+                m_index->append(chunk.index);
+            }
+        }
+
+        if (!reportProgress(current.back().end - data, size))
+        {
+            // the workers still read the mapped bytes
+            nextFuture.waitForFinished();
+            return;
+        }
+
+        current.swap(next);
+        future = nextFuture;
     }
 }
 
-void DmesgParser::parseOneLine(const QString &s)
+void DmesgParser::appendEvents(const std::vector<DmesgEvent> &events, int malformedLines)
 {
-    int timeBegin = s.indexOf('[');
-    int timeEnd = s.indexOf(']');
-    if (timeBegin < 0 || timeEnd <= 1)
+    for (const DmesgEvent &event : events)
     {
-        return;
+        applyEvent(event);
     }
+    m_malformedCount += malformedLines;
+    reportMalformed();
+    m_model.finalize();
+}
 
-    QString time = s.mid(timeBegin + 1, timeEnd - timeBegin - 1).trimmed();
+void DmesgParser::applyEvent(const DmesgEvent &event)
+{
+    switch (event.type)
+    {
+    case DmesgEvent::Fork:
+        m_model.addForkTask(event.pid, event.ppid, event.comm, event.commSize, event.time, event.kthread);
+        break;
+    case DmesgEvent::Exec:
+        m_model.addExecTask(event.pid, event.comm, event.commSize, event.time);
+        break;
+    case DmesgEvent::Exit:
+        m_model.taskExit(event.pid, event.time);
+        break;
+    }
+}
 
-    bool ok = true;
-    double dTime = time.toDouble(&ok);
-    if (!ok)
+void DmesgParser::applyWindowEvent(const DmesgEvent &event, const char *line, const char *lineEnd, int64_t begin)
+{
+    // The tasks forked before the window are added when an event shows
+    // them: the parent of a fork, or the task of an exec or exit. Every
+    // event carries the comm the task had then.
+    switch (event.type)
     {
-        return;
+    case DmesgEvent::Fork:
+        if (m_model.currentId(event.ppid) == -1)
+        {
+            m_model.addRunningTask(event.ppid, event.comm, event.commSize, begin);
+        }
+        break;
+    case DmesgEvent::Exec:
+        if (m_model.currentId(event.pid) == -1)
+        {
+            // the event only holds the new comm, "EXEC|172|S05modules|=|egrep"
+            Field list[3];
+            if (splitFields(line, lineEnd, list, 3) == 3)
+            {
+                m_model.addRunningTask(event.pid, list[2].begin, static_cast<int>(list[2].end - list[2].begin), begin);
+            }
+        }
+        break;
+    case DmesgEvent::Exit:
+        if (m_model.currentId(event.pid) == -1)
+        {
+            m_model.addRunningTask(event.pid, event.comm, event.commSize, begin);
+        }
+        break;
     }
 
-    int64_t i64Time = static_cast<int64_t>(dTime * 1000000);
-    QString body = s.mid(timeEnd + 2);
+    applyEvent(event);
+}
 
-    const QString FORK_PREFIX = "FORK|";
-    const QString EXEC_PREFIX = "EXEC|";
-    const QString EXIT_PREFIX = "EXIT|";
+bool DmesgParser::tokenizeLine(const char *begin, const char *end, DmesgEvent &event, int *malformed)
+{
+    if (begin < end && *(end - 1) == '\r')
+    {
+        end--;
+    }
 
-    if (body.startsWith(FORK_PREFIX))
+    const size_t size = static_cast<size_t>(end - begin);
+    const char *timeBegin = static_cast<const char *>(memchr(begin, '[', size));
+    const char *timeEnd = static_cast<const char *>(memchr(begin, ']', size));
+    if (!timeBegin || !timeEnd || timeEnd <= timeBegin)
     {
-        parseForkLine(i64Time, body);
+        return false;
     }
-    else if (body.startsWith(EXEC_PREFIX))
+
+    int64_t time = 0;
+    if (!parseTime(timeBegin + 1, timeEnd, time))
     {
-        parseExecLine(i64Time, body);
+        return false;
     }
-    else if (body.startsWith(EXIT_PREFIX))
+
+    const char *body = timeEnd + 2;
+    if (body >= end)
     {
-        parseExitLine(i64Time, body);
+        return false;
+    }
+
+    return tokenizeMessage(time, body, end, event, malformed);
+}
+
+bool DmesgParser::tokenizeMessage(int64_t time, const char *begin, const char *end, DmesgEvent &event,
+                                  int *malformed)
+{
+    if (begin < end && *(end - 1) == '\r')
+    {
+        end--;
+    }
+
+    event.time = time;
+
+    static const char FORK_PREFIX[] = "FORK|";
+    static const char EXEC_PREFIX[] = "EXEC|";
+    static const char EXIT_PREFIX[] = "EXIT|";
+    static const size_t PREFIX_SIZE = sizeof(FORK_PREFIX) - 1;
+
+    bool ok = false;
+    if (startsWith(begin, end, FORK_PREFIX, PREFIX_SIZE))
+    {
+        ok = tokenizeForkLine(begin, end, event);
+    }
+    else if (startsWith(begin, end, EXEC_PREFIX, PREFIX_SIZE))
+    {
+        ok = tokenizeExecLine(begin, end, event);
+    }
+    else if (startsWith(begin, end, EXIT_PREFIX, PREFIX_SIZE))
+    {
+        ok = tokenizeExitLine(begin, end, event);
     }
     else
     {
-        // do nothing
+        return false;
+    }
+
+    if (!ok && malformed)
+    {
+        (*malformed)++;
     }
+    return ok;
 }
 
-void DmesgParser::parseForkLine(int64_t time, const QString &s)
+bool DmesgParser::parseKmsgHeader(const char *begin, const char *end,
+                                  quint64 &seq, int64_t &time, const char *&message)
 {
-    // FORK|570|VBoxService|=>|571|0
-    QStringList list = s.split('|');
-    assert(list.size() >= 6);
+    // prio,seq,usec,flags[,more];message
+    const char *semicolon = static_cast<const char *>(memchr(begin, ';', static_cast<size_t>(end - begin)));
+    if (!semicolon)
+    {
+        return false;
+    }
 
-    int ppid = list[1].toInt();
-    int pid = list[4].toInt();
-    bool kthread = (list[5].toInt() != 0);
+    const char *p = begin;
+    int64_t values[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; i++)
+    {
+        const char *digits = p;
+        for (; p < semicolon && *p >= '0' && *p <= '9'; p++)
+        {
+            values[i] = values[i] * 10 + (*p - '0');
+        }
+        if (p == digits || p == semicolon || *p != ',')
+        {
+            return false;
+        }
+        p++;
+    }
 
-    m_model.addForkTask(pid, ppid, list[2], time, kthread);
+    seq = static_cast<quint64>(values[1]);
+    time = values[2];
+    message = semicolon + 1;
+    return true;
 }
 
-void DmesgParser::parseExecLine(int64_t time, const QString &s)
+bool DmesgParser::tokenizeForkLine(const char *begin, const char *end, DmesgEvent &event)
 {
-    // EXEC|569|S35vboxadd-serv|=|grep
-    QStringList list = s.split('|');
-    assert(list.size() >= 5);
+    // FORK|570|VBoxService|=>|571|0
+    Field list[6];
+    if (splitFields(begin, end, list, 6) < 6)
+    {
+        return false;
+    }
 
-    int pid = list[1].toInt();
+    event.type = DmesgEvent::Fork;
+    event.ppid = fieldToIntOrZero(list[1]);
+    event.pid = fieldToIntOrZero(list[4]);
+    event.kthread = (fieldToIntOrZero(list[5]) != 0);
+    event.comm = list[2].begin;
+    event.commSize = static_cast<int>(list[2].end - list[2].begin);
+    return true;
+}
 
-    m_model.addExecTask(pid, list[4], time);
+bool DmesgParser::tokenizeExecLine(const char *begin, const char *end, DmesgEvent &event)
+{
+    // EXEC|569|S35vboxadd-serv|=|grep
+    Field list[5];
+    if (splitFields(begin, end, list, 5) < 5)
+    {
+        return false;
+    }
+
+    event.type = DmesgEvent::Exec;
+    event.pid = fieldToIntOrZero(list[1]);
+    event.ppid = -1;
+    event.kthread = false;
+    event.comm = list[4].begin;
+    event.commSize = static_cast<int>(list[4].end - list[4].begin);
+    return true;
 }
 
-void DmesgParser::parseExitLine(int64_t time, const QString &s)
+bool DmesgParser::tokenizeExitLine(const char *begin, const char *end, DmesgEvent &event)
 {
     // EXIT|568|lsmod
-    QStringList list = s.split('|');
-    assert(list.size() >= 3);
-
-    int pid = list[1].toInt();
+    Field list[3];
+    if (splitFields(begin, end, list, 3) < 3)
+    {
+        return false;
+    }
 
-    m_model.taskExit(pid, time);
+    event.type = DmesgEvent::Exit;
+    event.pid = fieldToIntOrZero(list[1]);
+    event.ppid = -1;
+    event.kthread = false;
+    event.comm = list[2].begin;
+    event.commSize = static_cast<int>(list[2].end - list[2].begin);
+    return true;
 }
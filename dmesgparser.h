@@ -24,8 +24,32 @@
 
 #pragma once
 
+#include "logindex.h"
+#include "progress.h"
 #include "taskmodel.h"
 
+#include <QStringList>
+
+// One fork/exec/exit line of the kernel log. comm points into the
+// parsed bytes, so an event is only valid while they are.
+struct DmesgEvent
+{
+    enum Type : uint8_t
+    {
+        Fork,
+        Exec,
+        Exit
+    };
+
+    int64_t time;
+    const char *comm;
+    int commSize;
+    int pid;
+    int ppid;
+    Type type;
+    bool kthread;
+};
+
 class DmesgParser
 {
 public:
@@ -33,14 +57,91 @@ public:
 
     void parse(const QString &dmesg);
 
+    // map the file into memory and parse it in place
+    bool parseFile(const QString &path);
+    // Parse the terminated lines of a file which may still be growing,
+    // size is set to the bytes they span, where a LogFollower goes on.
+    bool parseFileLines(const QString &path, qint64 &size);
+
+    // Parse the file from the last indexed line before time, so that
+    // every event at or after time is read, along with the few which
+    // precede it in the same index interval. The sidecar index is built
+    // first if it is missing or stale, and saved if indexEnabled().
+    bool parseFileFrom(const QString &path, int64_t time);
+
+    // Parse only the events in [begin, end] (microsecond), seeking like
+    // parseFileFrom and reading no further than the window. The tasks
+    // running at begin are added when they are first seen, and the ones
+    // still living at end are stopped there.
+    bool parseFileWindow(const QString &path, int64_t begin, int64_t end);
+
+    // rotated logs, plain or gzip, merged by timestamp, see LogMerger
+    bool parseFiles(const QStringList &paths);
+    void parseWindow(const char *data, qint64 size, int64_t begin, int64_t end);
+
+    // build the sidecar index of every file parsed, see LogIndex
+    bool indexEnabled() const;
+    void setIndexEnabled(bool enabled);
+
+    // Reports the bytes parsed. A cancelled parse leaves the model
+    // with the tasks parsed so far, and the parseFile* functions return
+    // false.
+    void setProgressCallback(const ProgressCallback &callback);
+    bool cancelled() const;
+
+    // parse raw kernel log bytes without building any QString
+    void parseBytes(const char *data, qint64 size);
+
+    // same as parseBytes, but extend the model instead of clearing it first
+    void appendBytes(const char *data, qint64 size);
+
+    // number of threads tokenizing lines, the model is always built by the caller thread
+    int threadCount() const;
+    void setThreadCount(int threadCount);
+
+    // apply events tokenized elsewhere, e.g. by a capture thread, along
+    // with the count of malformed lines met there
+    void appendEvents(const std::vector<DmesgEvent> &events, int malformedLines = 0);
+
+    // "[    4.070211] FORK|170|S05modules|=>|172|0", a FORK, EXEC or EXIT
+    // line which lacks fields is counted in malformed, if it is not null
+    static bool tokenizeLine(const char *begin, const char *end, DmesgEvent &event, int *malformed = nullptr);
+
+    // "FORK|170|S05modules|=>|172|0", the message without its timestamp
+    static bool tokenizeMessage(int64_t time, const char *begin, const char *end, DmesgEvent &event,
+                                int *malformed = nullptr);
+
+    // "6,339,4070211,-;FORK|170|S05modules|=>|172|0", a /dev/kmsg record
+    static bool parseKmsgHeader(const char *begin, const char *end,
+                                quint64 &seq, int64_t &time, const char *&message);
+
 private:
-    void parseOneLine(const QString &s);
+    void parseSequential(const char *data, qint64 size);
+    void parseParallel(const char *data, qint64 size);
+
+    bool parseFileSeek(const QString &path, int64_t begin, int64_t end, bool window);
+
+    // false if the parse is cancelled
+    bool reportProgress(qint64 done, qint64 total);
+    // one summary of the malformed lines of a parse, instead of one per line
+    void reportMalformed();
 
-    void parseForkLine(int64_t time, const QString &s);
-    void parseExecLine(int64_t time, const QString &s);
-    void parseExitLine(int64_t time, const QString &s);
+    void applyEvent(const DmesgEvent &event);
+    // line is the one the event was tokenized from
+    void applyWindowEvent(const DmesgEvent &event, const char *line, const char *lineEnd, int64_t begin);
+
+    static bool tokenizeForkLine(const char *begin, const char *end, DmesgEvent &event);
+    static bool tokenizeExecLine(const char *begin, const char *end, DmesgEvent &event);
+    static bool tokenizeExitLine(const char *begin, const char *end, DmesgEvent &event);
 
 private:
     TaskModel &m_model;
+    int m_threadCount;
+    bool m_indexEnabled;
+    // filled by the parse in progress, if any
+    LogIndex *m_index;
+    ProgressCallback m_progress;
+    bool m_cancelled;
+    // FORK, EXEC and EXIT lines skipped since the last report
+    int m_malformedCount;
 };
-
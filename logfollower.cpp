@@ -0,0 +1,264 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "logfollower.h"
+
+#include <QFileInfo>
+#include <QDebug>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+static quint64 inodeOf(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) == 0)
+    {
+        return static_cast<quint64>(st.st_ino);
+    }
+#else
+    Q_UNUSED(path);
+#endif
+    return 0;
+}
+
+LogFollower::LogFollower(TaskModel &model, QObject *parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_parser(model)
+    , m_inode(0)
+    , m_offset(0)
+{
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &LogFollower::onFileChanged);
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &LogFollower::onDirectoryChanged);
+}
+
+bool LogFollower::start(const QString &path, qint64 offset)
+{
+    stop();
+
+    m_path = path;
+    if (!openFile())
+    {
+        m_path.clear();
+        return false;
+    }
+
+    const int firstNewId = m_model.taskCount();
+    m_offset = offset;
+    const bool changed = readAppended();
+    watch();
+
+    if (changed)
+    {
+        emit modelUpdated(firstNewId);
+    }
+    return true;
+}
+
+void LogFollower::stop()
+{
+    if (!m_watcher.files().isEmpty())
+    {
+        m_watcher.removePaths(m_watcher.files());
+    }
+    if (!m_watcher.directories().isEmpty())
+    {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+
+    m_file.close();
+    m_path.clear();
+    m_inode = 0;
+    m_offset = 0;
+    m_partial.clear();
+}
+
+bool LogFollower::isFollowing() const
+{
+    return !m_path.isEmpty();
+}
+
+QString LogFollower::path() const
+{
+    return m_path;
+}
+
+void LogFollower::onFileChanged()
+{
+    if (!isFollowing())
+    {
+        return;
+    }
+
+    const int firstNewId = m_model.taskCount();
+
+    // drain what was written to the old file before it got rotated away
+    bool changed = readAppended();
+
+    if (!m_file.isOpen() || fileReplaced())
+    {
+        if (m_file.isOpen())
+        {
+            qDebug() << "log rotated:" << m_path;
+            m_file.close();
+
+            // the old file will not grow anymore, so its last line is complete
+            changed = changed || !m_partial.isEmpty();
+            m_parser.appendBytes(m_partial.constData(), m_partial.size());
+            m_partial.clear();
+        }
+
+        // if it is not recreated yet, the directory watch brings us back
+        if (openFile())
+        {
+            changed = readAppended() || changed;
+        }
+    }
+
+    // the watcher drops a path once the file is removed or renamed
+    watch();
+
+    if (changed)
+    {
+        emit modelUpdated(firstNewId);
+    }
+}
+
+void LogFollower::onDirectoryChanged()
+{
+    if (isFollowing() && (!m_file.isOpen() || fileReplaced()))
+    {
+        onFileChanged();
+    }
+}
+
+bool LogFollower::openFile()
+{
+    m_file.setFileName(m_path);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << m_file.errorString();
+        return false;
+    }
+
+    m_inode = inodeOf(m_path);
+    m_offset = 0;
+    return true;
+}
+
+bool LogFollower::fileReplaced() const
+{
+    const quint64 inode = inodeOf(m_path);
+    return inode != 0 && inode != m_inode;
+}
+
+void LogFollower::watch()
+{
+    if (QFileInfo::exists(m_path) && !m_watcher.files().contains(m_path))
+    {
+        m_watcher.addPath(m_path);
+    }
+
+    const QString dir = QFileInfo(m_path).absolutePath();
+    if (!m_watcher.directories().contains(dir))
+    {
+        m_watcher.addPath(dir);
+    }
+}
+
+bool LogFollower::readAppended()
+{
+    if (!m_file.isOpen())
+    {
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    if (size < m_offset)
+    {
+        // truncated in place (e.g. logrotate copytruncate), the new
+        // content continues the same log from the beginning of the file
+        qDebug() << "log truncated:" << m_path << m_offset << "->" << size;
+        m_offset = 0;
+        m_partial.clear();
+    }
+
+    if (size == m_offset)
+    {
+        return false;
+    }
+
+    const qint64 appended = size - m_offset;
+    const uchar *data = m_file.map(m_offset, appended);
+    if (data)
+    {
+        consume(reinterpret_cast<const char *>(data), appended);
+        m_file.unmap(const_cast<uchar *>(data));
+    }
+    else
+    {
+        m_file.seek(m_offset);
+        const QByteArray bytes = m_file.read(appended);
+        consume(bytes.constData(), bytes.size());
+    }
+
+    m_offset = size;
+    return true;
+}
+
+void LogFollower::consume(const char *data, qint64 size)
+{
+    const char *p = data;
+    const char *end = data + size;
+
+    if (!m_partial.isEmpty())
+    {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(size)));
+        if (!eol)
+        {
+            m_partial.append(p, static_cast<int>(size));
+            return;
+        }
+
+        m_partial.append(p, static_cast<int>(eol - p));
+        m_parser.appendBytes(m_partial.constData(), m_partial.size());
+        m_partial.clear();
+        p = eol + 1;
+    }
+
+    // everything after the last newline waits for the rest of its line
+    const char *complete = end;
+    while (complete > p && *(complete - 1) != '\n')
+    {
+        complete--;
+    }
+
+    m_parser.appendBytes(p, complete - p);
+    m_partial.append(complete, static_cast<int>(end - complete));
+}
@@ -0,0 +1,78 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include "dmesgparser.h"
+
+#include <QObject>
+#include <QFile>
+#include <QFileSystemWatcher>
+
+// Keep a TaskModel in sync with a growing log file, like tail -f.
+// Only the bytes appended since the last update are parsed.
+class LogFollower : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LogFollower(TaskModel &model, QObject *parent = nullptr);
+
+    // Watch the file, whose first offset bytes are already in the model,
+    // see LoadRequest::follow. What was appended since is parsed first.
+    bool start(const QString &path, qint64 offset);
+    void stop();
+
+    bool isFollowing() const;
+    QString path() const;
+
+signals:
+    // the model has been extended, tasks from firstNewId on are new
+    void modelUpdated(int firstNewId);
+
+private slots:
+    void onFileChanged();
+    void onDirectoryChanged();
+
+private:
+    bool openFile();
+    bool fileReplaced() const;
+    void watch();
+
+    bool readAppended();
+    void consume(const char *data, qint64 size);
+
+private:
+    TaskModel &m_model;
+    DmesgParser m_parser;
+    QFileSystemWatcher m_watcher;
+
+    QString m_path;
+    QFile m_file;
+    quint64 m_inode;
+
+    // bytes of m_file already consumed
+    qint64 m_offset;
+    // the trailing line which has not been terminated yet
+    QByteArray m_partial;
+};
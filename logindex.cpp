@@ -0,0 +1,208 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "logindex.h"
+#include "dmesgparser.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+namespace
+{
+
+const char INDEX_MAGIC[8] = {'T', 'T', 'I', 'N', 'D', 'E', 'X', '\0'};
+const uint32_t INDEX_VERSION = 1;
+// read back as another value on a host of the other byte order
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    int64_t logSize;
+    int64_t logModified;    // millisecond since epoch
+    uint64_t count;
+};
+
+bool entryTimeLess(const LogIndex::Entry &entry, int64_t time)
+{
+    return entry.time < time;
+}
+
+}
+
+LogIndex::LogIndex()
+    : m_eventsSinceEntry(0)
+    , m_latestTime(std::numeric_limits<int64_t>::min())
+{
+
+}
+
+QString LogIndex::sidecarPath(const QString &logPath)
+{
+    return logPath + ".tti";
+}
+
+void LogIndex::clear()
+{
+    m_entries.clear();
+    m_eventsSinceEntry = 0;
+    m_latestTime = std::numeric_limits<int64_t>::min();
+}
+
+void LogIndex::addEntry(int64_t offset)
+{
+    Entry entry = {m_latestTime, offset};
+    m_entries.push_back(entry);
+    m_eventsSinceEntry = 0;
+}
+
+void LogIndex::append(const LogIndex &other)
+{
+    // the latest time of other only covers its own lines
+    for (Entry entry : other.m_entries)
+    {
+        entry.time = std::max(entry.time, m_latestTime);
+        m_entries.push_back(entry);
+    }
+    m_latestTime = std::max(m_latestTime, other.m_latestTime);
+    m_eventsSinceEntry = other.m_entries.empty() ? m_eventsSinceEntry + other.m_eventsSinceEntry
+                                                 : other.m_eventsSinceEntry;
+}
+
+int64_t LogIndex::seek(int64_t time) const
+{
+    // the last entry earlier than time
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), time, entryTimeLess);
+    if (it == m_entries.begin())
+    {
+        return 0;
+    }
+    return (it - 1)->offset;
+}
+
+void LogIndex::build(const char *data, int64_t size)
+{
+    clear();
+
+    const char *p = data;
+    const char *end = data + size;
+    while (p < end)
+    {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!lineEnd)
+        {
+            lineEnd = end;
+        }
+
+        DmesgEvent event;
+        if (DmesgParser::tokenizeLine(p, lineEnd, event))
+        {
+            addEvent(event.time, p - data);
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+bool LogIndex::load(const QString &logPath)
+{
+    clear();
+
+    const QFileInfo log(logPath);
+    QFile file(sidecarPath(logPath));
+    if (!log.exists() || !file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    IndexHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+            || memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0
+            || header.version != INDEX_VERSION || header.byteOrder != BYTE_ORDER_MARK)
+    {
+        qDebug() << "not an index of version" << INDEX_VERSION << ":" << file.fileName();
+        return false;
+    }
+
+    if (header.logSize != log.size() || header.logModified != log.lastModified().toMSecsSinceEpoch())
+    {
+        qDebug() << "index is stale:" << file.fileName();
+        return false;
+    }
+
+    const int64_t bytes = static_cast<int64_t>(sizeof(Entry) * header.count);
+    if (header.count > static_cast<uint64_t>(file.size()) || file.size() - file.pos() != bytes)
+    {
+        qDebug() << "index is truncated:" << file.fileName();
+        return false;
+    }
+
+    m_entries.resize(static_cast<size_t>(header.count));
+    if (file.read(reinterpret_cast<char *>(m_entries.data()), bytes) != bytes)
+    {
+        qDebug() << file.errorString();
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool LogIndex::save(const QFileInfo &log) const
+{
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.logSize = log.size();
+    header.logModified = log.lastModified().toMSecsSinceEpoch();
+    header.count = m_entries.size();
+
+    QSaveFile file(sidecarPath(log.filePath()));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+
+    const int64_t bytes = static_cast<int64_t>(sizeof(Entry) * m_entries.size());
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+    ok = ok && file.write(reinterpret_cast<const char *>(m_entries.data()), bytes) == bytes;
+    if (!ok || !file.commit())
+    {
+        qDebug() << "cannot write index:" << file.fileName() << file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include <QFileInfo>
+#include <QString>
+
+#include <vector>
+
+#include <stdint.h>
+
+// A sparse index of a kernel log: the byte offset of an event line
+// every LINE_INTERVAL events, or whenever TIME_INTERVAL has passed
+// since the last entry. It is kept next to the log as "<log>.tti" and
+// reused while the size and mtime of the log are unchanged.
+//
+// The timestamps are only monotonic within a boot, and printk from
+// several CPUs may even swap a few lines, so an entry holds the latest
+// time seen so far. That never goes back and can be binary searched; a
+// later boot is merely found at an earlier offset than needed.
+class LogIndex
+{
+public:
+    struct Entry
+    {
+        int64_t time;   // microsecond, the latest of the event lines up to offset
+        int64_t offset;
+    };
+
+    static const int LINE_INTERVAL = 4096;
+    static const int64_t TIME_INTERVAL = 1000000;
+
+    LogIndex();
+
+    static QString sidecarPath(const QString &logPath);
+
+    void clear();
+    bool isEmpty() const { return m_entries.empty(); }
+    const std::vector<Entry> &entries() const { return m_entries; }
+
+    // called for every event line, in file order
+    void addEvent(int64_t time, int64_t offset)
+    {
+        if (time > m_latestTime)
+        {
+            m_latestTime = time;
+        }
+        if (m_eventsSinceEntry >= LINE_INTERVAL || m_entries.empty()
+                || m_latestTime - m_entries.back().time >= TIME_INTERVAL)
+        {
+            addEntry(offset);
+        }
+        m_eventsSinceEntry++;
+    }
+
+    // append the entries of the lines which follow the ones of this index
+    void append(const LogIndex &other);
+
+    // Offset of a line before which every event is earlier than time,
+    // so parsing from there loses nothing at or after it.
+    int64_t seek(int64_t time) const;
+
+    // scan the whole log, for a log which was not indexed while parsed
+    void build(const char *data, int64_t size);
+
+    // the sidecar of logPath, false if it is missing or the log changed since
+    bool load(const QString &logPath);
+    // log is taken before the log is read, so a log which grows
+    // meanwhile leaves a sidecar which is stale at once
+    bool save(const QFileInfo &log) const;
+
+private:
+    void addEntry(int64_t offset);
+
+private:
+    std::vector<Entry> m_entries;
+    int m_eventsSinceEntry;
+    int64_t m_latestTime;
+};
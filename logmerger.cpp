@@ -0,0 +1,476 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "logmerger.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+#include <zlib.h>
+
+namespace
+{
+
+// bytes read from a file at a time, a longer line grows the buffer
+const size_t BLOCK_SIZE = 1024 * 1024;
+
+}
+
+// Reads the event lines of one file, plain or gzip, a block at a time.
+class LogSource
+{
+public:
+    explicit LogSource(const QString &path);
+    ~LogSource();
+
+    bool open();
+
+    qint64 position() const { return gzoffset(m_file); }
+    qint64 size() const { return m_size; }
+
+    // tokenize the next event line, false at the end of the file
+    bool advance();
+    bool hasEvent() const { return m_hasEvent; }
+    const DmesgEvent &event() const { return m_event; }
+
+    // the boot of the event, counted from the base set when the file
+    // joins the merge, it grows each time the timestamp goes back
+    int segment() const { return m_segment; }
+    void setSegment(int segment) { m_segment = segment; }
+    // the timestamp of the first event of the segment
+    int64_t segmentStart() const { return m_segmentStart; }
+    // the file has been read to its end, and its timestamp does not go
+    // back in the lines left
+    bool inLastSegment() const { return m_allRead && m_lineBegin >= m_lastReset; }
+    // the timestamp of the last event, once the whole file is read
+    int64_t endTime() const { return m_endTime; }
+    // an event has been read
+    bool started() const { return m_started; }
+    int malformedLines() const { return m_malformedLines; }
+
+private:
+    // lastTime is the timestamp of the last event, if started()
+    bool fill(int64_t lastTime);
+    // find the last line of the buffer whose timestamp goes back
+    void findLastReset(bool started, int64_t lastTime);
+
+private:
+    QString m_path;
+    gzFile m_file;
+    qint64 m_size;
+    std::vector<char> m_buffer;
+    // the bytes not tokenized yet
+    size_t m_begin;
+    size_t m_end;
+    bool m_eof;
+    // the whole file is in the buffer
+    bool m_allRead;
+    bool m_started;
+    bool m_hasEvent;
+    DmesgEvent m_event;
+    // where the line of the event starts in the buffer
+    size_t m_lineBegin;
+    int m_segment;
+    int64_t m_segmentStart;
+    // where the last line whose timestamp goes back starts in the
+    // buffer, 0 if there is none, once the whole file is read
+    size_t m_lastReset;
+    int64_t m_endTime;
+    int m_malformedLines;
+};
+
+LogSource::LogSource(const QString &path)
+    : m_path(path)
+    , m_file(nullptr)
+    , m_size(0)
+    , m_begin(0)
+    , m_end(0)
+    , m_eof(false)
+    , m_allRead(false)
+    , m_started(false)
+    , m_hasEvent(false)
+    , m_event()
+    , m_lineBegin(0)
+    , m_segment(0)
+    , m_segmentStart(0)
+    , m_lastReset(0)
+    , m_endTime(0)
+    , m_malformedLines(0)
+{
+
+}
+
+LogSource::~LogSource()
+{
+    if (m_file)
+    {
+        gzclose(m_file);
+    }
+}
+
+bool LogSource::open()
+{
+    // zlib reads a file without the gzip magic as it is
+    m_file = gzopen(QFile::encodeName(m_path).constData(), "rb");
+    if (!m_file)
+    {
+        qDebug() << "cannot open" << m_path;
+        return false;
+    }
+    gzbuffer(m_file, BLOCK_SIZE / 4);
+    m_size = QFileInfo(m_path).size();
+    m_buffer.resize(BLOCK_SIZE);
+    return true;
+}
+
+bool LogSource::advance()
+{
+    const int64_t lastTime = m_event.time;
+    for (;;)
+    {
+        const char *data = m_buffer.data();
+        const char *begin = data + m_begin;
+        const char *end = data + m_end;
+        const char *eol = static_cast<const char *>(memchr(begin, '\n', m_end - m_begin));
+
+        if (!eol && !m_eof)
+        {
+            // m_event holds the last line tokenized, not the last event
+            fill(lastTime);
+            continue;
+        }
+        if (!eol && begin == end)
+        {
+            m_hasEvent = false;
+            return false;
+        }
+
+        // the last line may have no '\n'
+        const char *lineEnd = eol ? eol : end;
+        m_begin = eol ? static_cast<size_t>(eol - data) + 1 : m_end;
+        if (DmesgParser::tokenizeLine(begin, lineEnd, m_event, &m_malformedLines))
+        {
+            if (!m_started || m_event.time < lastTime)
+            {
+                m_segment += m_started;
+                m_segmentStart = m_event.time;
+            }
+            m_started = true;
+            m_hasEvent = true;
+            m_lineBegin = static_cast<size_t>(begin - data);
+            return true;
+        }
+    }
+}
+
+bool LogSource::fill(int64_t lastTime)
+{
+    // the last event is not used any more, only the partial line is kept
+    memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+    m_end -= m_begin;
+    m_lastReset = m_lastReset > m_begin ? m_lastReset - m_begin : 0;
+    m_begin = 0;
+    if (m_end == m_buffer.size())
+    {
+        m_buffer.resize(m_buffer.size() * 2);
+    }
+
+    const size_t space = std::min<size_t>(m_buffer.size() - m_end, std::numeric_limits<int>::max());
+    const int n = gzread(m_file, m_buffer.data() + m_end, static_cast<unsigned>(space));
+    if (n < 0)
+    {
+        int error = 0;
+        qDebug() << "cannot read" << m_path << gzerror(m_file, &error);
+    }
+    else
+    {
+        m_end += static_cast<size_t>(n);
+    }
+
+    if (!m_allRead && (n <= 0 || gzeof(m_file)))
+    {
+        m_allRead = true;
+        findLastReset(m_started, lastTime);
+    }
+    if (n <= 0)
+    {
+        m_eof = true;
+        return false;
+    }
+    return true;
+}
+
+void LogSource::findLastReset(bool started, int64_t lastTime)
+{
+    m_lastReset = 0;
+    DmesgEvent event;
+    const char *data = m_buffer.data();
+    const char *end = data + m_end;
+    for (const char *begin = data + m_begin; begin < end;)
+    {
+        const char *eol = static_cast<const char *>(memchr(begin, '\n', static_cast<size_t>(end - begin)));
+        const char *lineEnd = eol ? eol : end;
+        if (DmesgParser::tokenizeLine(begin, lineEnd, event))
+        {
+            if (started && event.time < lastTime)
+            {
+                m_lastReset = static_cast<size_t>(begin - data);
+            }
+            started = true;
+            lastTime = event.time;
+        }
+        begin = lineEnd + 1;
+    }
+    m_endTime = lastTime;
+}
+
+LogMerger::LogMerger()
+    : m_admitted(0)
+    , m_current(-1)
+{
+
+}
+
+LogMerger::~LogMerger()
+{
+
+}
+
+bool LogMerger::isCompressed(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    unsigned char magic[2];
+    return file.read(reinterpret_cast<char *>(magic), sizeof(magic)) == sizeof(magic)
+            && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+QStringList LogMerger::sortByRotation(const QStringList &paths)
+{
+    // (kind, order): the dated files by date, the numbered ones from the
+    // largest number, then the others
+    std::vector<std::pair<std::pair<int, qint64>, QString>> keyed;
+    for (const QString &path : paths)
+    {
+        QString name = QFileInfo(path).fileName();
+        if (name.endsWith(QLatin1String(".gz")))
+        {
+            name.chop(3);
+        }
+        int digits = name.size();
+        while (digits > 0 && name[digits - 1].isDigit())
+        {
+            digits--;
+        }
+
+        std::pair<int, qint64> key(2, 0);
+        if (digits > 0 && digits < name.size())
+        {
+            const qint64 number = name.mid(digits).toLongLong();
+            if (name[digits - 1] == QLatin1Char('-'))
+            {
+                key = std::make_pair(0, number);
+            }
+            else if (name[digits - 1] == QLatin1Char('.'))
+            {
+                key = std::make_pair(1, -number);
+            }
+        }
+        keyed.push_back(std::make_pair(key, path));
+    }
+
+    std::stable_sort(keyed.begin(), keyed.end(), [](const std::pair<std::pair<int, qint64>, QString> &a,
+                                                    const std::pair<std::pair<int, qint64>, QString> &b) {
+        return a.first < b.first;
+    });
+
+    QStringList result;
+    for (const auto &entry : keyed)
+    {
+        result.append(entry.second);
+    }
+    return result;
+}
+
+bool LogMerger::open(const QStringList &paths)
+{
+    close();
+
+    for (const QString &path : sortByRotation(paths))
+    {
+        std::unique_ptr<LogSource> source(new LogSource(path));
+        if (!source->open())
+        {
+            close();
+            return false;
+        }
+        m_sources.push_back(std::move(source));
+    }
+
+    for (const std::unique_ptr<LogSource> &source : m_sources)
+    {
+        source->advance();
+    }
+    admitSources();
+    return true;
+}
+
+qint64 LogMerger::position() const
+{
+    qint64 result = 0;
+    for (const std::unique_ptr<LogSource> &source : m_sources)
+    {
+        result += source->position();
+    }
+    return result;
+}
+
+qint64 LogMerger::size() const
+{
+    qint64 result = 0;
+    for (const std::unique_ptr<LogSource> &source : m_sources)
+    {
+        result += source->size();
+    }
+    return result;
+}
+
+int LogMerger::malformedLines() const
+{
+    int result = 0;
+    for (const std::unique_ptr<LogSource> &source : m_sources)
+    {
+        result += source->malformedLines();
+    }
+    return result;
+}
+
+void LogMerger::close()
+{
+    m_sources.clear();
+    m_admitted = 0;
+    m_heap.clear();
+    m_current = -1;
+}
+
+bool LogMerger::next(DmesgEvent &event)
+{
+    if (m_current != -1)
+    {
+        if (m_sources[static_cast<size_t>(m_current)]->advance())
+        {
+            push(m_current);
+        }
+        if (m_current == m_admitted - 1)
+        {
+            admitSources();
+        }
+        m_current = -1;
+    }
+
+    if (m_heap.empty())
+    {
+        return false;
+    }
+
+    std::pop_heap(m_heap.begin(), m_heap.end(), [this](int a, int b) { return later(a, b); });
+    m_current = m_heap.back();
+    m_heap.pop_back();
+
+    event = m_sources[static_cast<size_t>(m_current)]->event();
+    return true;
+}
+
+void LogMerger::push(int source)
+{
+    m_heap.push_back(source);
+    std::push_heap(m_heap.begin(), m_heap.end(), [this](int a, int b) { return later(a, b); });
+}
+
+bool LogMerger::later(int a, int b) const
+{
+    const LogSource &sourceA = *m_sources[static_cast<size_t>(a)];
+    const LogSource &sourceB = *m_sources[static_cast<size_t>(b)];
+    if (sourceA.segment() != sourceB.segment())
+    {
+        return sourceA.segment() > sourceB.segment();
+    }
+    const int64_t timeA = sourceA.event().time;
+    const int64_t timeB = sourceB.event().time;
+    return timeA > timeB || (timeA == timeB && a > b);
+}
+
+void LogMerger::admitSources()
+{
+    const int sourceCount = static_cast<int>(m_sources.size());
+    while (m_admitted < sourceCount)
+    {
+        LogSource &source = *m_sources[static_cast<size_t>(m_admitted)];
+        if (m_admitted > 0)
+        {
+            // A rotated file either continues the last boot of the one
+            // before it, overlapping it at most at its end, or starts a
+            // new boot, whose timestamps restart near where that boot
+            // started. It is told once the one before is in its last
+            // boot, and a continuation waits until it reaches the first
+            // event of the file.
+            const LogSource &last = *m_sources[static_cast<size_t>(m_admitted - 1)];
+            int segment = last.segment();
+            if (source.hasEvent() && last.started())
+            {
+                if (!last.inLastSegment())
+                {
+                    break;
+                }
+                const int64_t time = source.event().time;
+                const int64_t start = last.segmentStart();
+                if (time < start || time - start < last.endTime() - time)
+                {
+                    segment++;
+                }
+                else if (last.hasEvent() && time > last.event().time)
+                {
+                    break;
+                }
+            }
+            source.setSegment(segment);
+        }
+
+        if (source.hasEvent())
+        {
+            push(m_admitted);
+        }
+        m_admitted++;
+    }
+}
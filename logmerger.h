@@ -0,0 +1,93 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include "dmesgparser.h"
+
+#include <QStringList>
+
+#include <memory>
+#include <vector>
+
+class LogSource;
+
+// Merge several kernel logs, e.g. kern.log.2.gz, kern.log.1 and
+// kern.log, into one stream of events ordered by timestamp. The files
+// are read block by block and gzip ones are decompressed on the fly,
+// so only a block of each file is in memory at a time.
+//
+// The files are taken oldest first by their rotation suffix, whatever
+// the order of the paths, and events with the same timestamp keep that
+// order. Timestamps restart at each boot, so a file whose timestamp
+// goes back starts a new segment, and events are only merged within a
+// segment. A file continues the last segment of the file before it if
+// its first timestamp is nearer the end of that segment than its start,
+// otherwise it starts a new one: rotated files overlap at most at their
+// boundary, while a new boot restarts near zero.
+class LogMerger
+{
+public:
+    LogMerger();
+    ~LogMerger();
+
+    LogMerger(const LogMerger &) = delete;
+    LogMerger &operator=(const LogMerger &) = delete;
+
+    // the file starts with the gzip magic
+    static bool isCompressed(const QString &path);
+    // paths oldest first: kern.log-20200105, ..., kern.log.2.gz,
+    // kern.log.1, kern.log, the others keep their order
+    static QStringList sortByRotation(const QStringList &paths);
+
+    bool open(const QStringList &paths);
+    void close();
+
+    // bytes of the files read so far and in total, compressed ones as they are on disk
+    qint64 position() const;
+    qint64 size() const;
+    // FORK, EXEC and EXIT lines skipped so far, see DmesgParser::tokenizeLine()
+    int malformedLines() const;
+
+    // The next event of all the files, false at the end. comm of the
+    // event is only valid until the next call.
+    bool next(DmesgEvent &event);
+
+private:
+    void push(int source);
+    // the event of source a comes after the one of b
+    bool later(int a, int b) const;
+    // merge the next files once the last one merged reaches them
+    void admitSources();
+
+private:
+    std::vector<std::unique_ptr<LogSource>> m_sources;
+    // the files merged so far, the others wait for the one before them
+    int m_admitted;
+    // min-heap of the sources which have an event, by (segment, time, source)
+    std::vector<int> m_heap;
+    // the source whose event next() returned last, it advances on the next call
+    int m_current;
+};
@@ -23,15 +23,144 @@
  ********************************************************************************/
 
 #include "mainwindow.h"
+#include "modelloader.h"
+#include "textlayouter.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 
 int main(int argc, char *argv[])
 {
     qSetMessagePattern("%{time yyyy-MM-dd h:mm:ss.zzz} [%{type}] (%{file}:%{line}) %{function} - %{message}");
 
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption captureOption("capture",
+                                     "Capture records from <source>: /dev/kmsg, - for stdin, or a named pipe.",
+                                     "source");
+    parser.addOption(captureOption);
+    QCommandLineOption tileCacheOption("tile-cache",
+                                       "Memory budget of the timeline tiles in MiB.",
+                                       "MiB");
+    parser.addOption(tileCacheOption);
+    QCommandLineOption saveSnapshotOption("save-snapshot",
+                                          "Parse <files> and save them as a snapshot to <path> without opening a window.",
+                                          "path");
+    parser.addOption(saveSnapshotOption);
+    QCommandLineOption exportTextOption("export-text",
+                                        "Parse <files> and write their text tree to <path>, - for stdout, "
+                                        "without opening a window.",
+                                        "path");
+    parser.addOption(exportTextOption);
+    QCommandLineOption compactOption("compact",
+                                     "Export the text tree with a fixed indentation per level and one exec per line.");
+    parser.addOption(compactOption);
+    QCommandLineOption maxLevelsOption("max-levels",
+                                       "With --compact, show at most <n> levels of ancestor columns, "
+                                       "the ones above are elided.",
+                                       "n");
+    parser.addOption(maxLevelsOption);
+    QCommandLineOption indexOption("index",
+                                   "Keep a sidecar time index (<log>.tti) next to the logs opened.");
+    parser.addOption(indexOption);
+    QCommandLineOption fromOption("from",
+                                  "Read the log only from <second> on, seeking with the sidecar index.",
+                                  "second");
+    parser.addOption(fromOption);
+    QCommandLineOption toOption("to",
+                                "Read the log only up to <second>, the tasks living then are stopped there.",
+                                "second");
+    parser.addOption(toOption);
+    parser.addPositionalArgument("files", "Kernel log or snapshot (.ttm) to open. Several logs, plain or gzip, "
+                                          "are merged by timestamp, e.g. kern.log.2.gz kern.log.1 kern.log.",
+                                 "[files...]");
+    parser.process(a);
+
+    const QStringList files = parser.positionalArguments();
+
+    LoadRequest request;
+    request.paths = files;
+    request.indexEnabled = parser.isSet(indexOption);
+    if (parser.isSet(fromOption))
+    {
+        bool ok = false;
+        const double second = parser.value(fromOption).toDouble(&ok);
+        if (!ok || second < 0)
+        {
+            parser.showHelp(1);
+        }
+        request.fromTime = static_cast<int64_t>(second * 1000000);
+    }
+    if (parser.isSet(toOption))
+    {
+        bool ok = false;
+        const double second = parser.value(toOption).toDouble(&ok);
+        if (!ok || second * 1000000 < request.fromTime)
+        {
+            parser.showHelp(1);
+        }
+        request.toTime = static_cast<int64_t>(second * 1000000);
+    }
+
+    TextTreeStyle style;
+    style.compact = parser.isSet(compactOption);
+    if (parser.isSet(maxLevelsOption))
+    {
+        bool ok = false;
+        style.maxLevels = parser.value(maxLevelsOption).toInt(&ok);
+        // the aligned style has no elision
+        if (!ok || style.maxLevels < 0 || !style.compact)
+        {
+            parser.showHelp(1);
+        }
+    }
+
+    if (parser.isSet(saveSnapshotOption) || parser.isSet(exportTextOption))
+    {
+        if (files.isEmpty())
+        {
+            parser.showHelp(1);
+        }
+
+        TaskModel model;
+        bool ok = ModelLoader::parse(model, request);
+        if (ok && parser.isSet(saveSnapshotOption))
+        {
+            ok = model.save(parser.value(saveSnapshotOption));
+        }
+        if (ok && parser.isSet(exportTextOption))
+        {
+            TextLayouter tl(model);
+            tl.setStyle(style);
+            ok = tl.layoutToFile(parser.value(exportTextOption));
+        }
+        return ok ? 0 : 1;
+    }
+
     MainWindow w;
+    w.setIndexEnabled(parser.isSet(indexOption));
+    if (parser.isSet(tileCacheOption))
+    {
+        bool ok = false;
+        const int size = parser.value(tileCacheOption).toInt(&ok);
+        if (!ok || size <= 0)
+        {
+            parser.showHelp(1);
+        }
+        w.setTileCacheSize(size * 1024);
+    }
     w.show();
+
+    if (parser.isSet(captureOption))
+    {
+        w.startCapture(parser.value(captureOption));
+    }
+    else if (!files.isEmpty())
+    {
+        w.open(request);
+    }
+
     return a.exec();
 }
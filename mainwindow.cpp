@@ -22,20 +22,57 @@
  * SOFTWARE.
  ********************************************************************************/
 
-#include "dmesgparser.h"
 #include "mainwindow.h"
 #include "textlayouter.h"
 #include "ui_mainwindow.h"
 
+#include <QApplication>
 #include <QFileDialog>
-#include <QFile>
+#include <QInputDialog>
+#include <QProgressBar>
+#include <QShortcut>
+#include <QStatusBar>
+#include <QToolButton>
 #include <QDebug>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_model(std::make_shared<TaskModel>())
+    , m_follower(*m_model)
+    , m_capture(*m_model)
+    , m_loadProgress(new QProgressBar(this))
+    , m_loadCancel(new QToolButton(this))
+    , m_lostRecords(0)
+    , m_indexEnabled(false)
 {
     ui->setupUi(this);
+
+    ui->treeView->setModel(&m_treeModel);
+    ui->treeView->setColumnWidth(TaskTreeModel::TaskColumn, 480);
+
+    m_loadProgress->setRange(0, 100);
+    m_loadProgress->setMaximumWidth(200);
+    m_loadProgress->hide();
+    m_loadCancel->setText(tr("Cancel"));
+    m_loadCancel->hide();
+    statusBar()->addPermanentWidget(m_loadProgress);
+    statusBar()->addPermanentWidget(m_loadCancel);
+
+    QShortcut *findShortcut = new QShortcut(QKeySequence::Find, this);
+    connect(findShortcut, &QShortcut::activated, this, [this]() {
+        ui->tabWidget->setCurrentWidget(ui->tab);
+        ui->lineEditFind->setFocus();
+        ui->lineEditFind->selectAll();
+    });
+
+    connect(m_loadCancel, &QToolButton::clicked, this, &MainWindow::cancelLoad);
+    connect(&m_loader, &ModelLoader::progressChanged, this, &MainWindow::onLoadProgress);
+    connect(&m_loader, &ModelLoader::finished, this, &MainWindow::onLoadFinished);
+
+    connect(&m_follower, &LogFollower::modelUpdated, this, &MainWindow::onModelUpdated);
+    connect(&m_capture, &StreamSource::modelUpdated, this, &MainWindow::onModelUpdated);
+    connect(&m_capture, &StreamSource::recordsLost, this, &MainWindow::onRecordsLost);
 }
 
 MainWindow::~MainWindow()
@@ -43,7 +80,65 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::startCapture(const QString &source)
+{
+    ui->actionFollow->setChecked(false);
+    cancelLoad();
+
+    m_lostRecords = 0;
+    m_model->setRecordStopped(true);
+    if (!m_capture.start(source))
+    {
+        statusBar()->showMessage(tr("Cannot capture from %1").arg(source));
+        return;
+    }
+    statusBar()->showMessage(tr("Capturing from %1").arg(source));
+}
+
+void MainWindow::setTileCacheSize(int kilobytes)
+{
+    ui->widgetTimeline->setTileCacheSize(kilobytes);
+}
+
+void MainWindow::setIndexEnabled(bool enabled)
+{
+    m_indexEnabled = enabled;
+}
+
+void MainWindow::open(const LoadRequest &request)
+{
+    ui->actionFollow->setChecked(false);
+    m_capture.stop();
+    m_model->setRecordStopped(false);
+    startLoad(request);
+}
+
+void MainWindow::startLoad(const LoadRequest &request)
+{
+    m_loader.start(request);
+    m_loadProgress->setValue(0);
+    m_loadProgress->show();
+    m_loadCancel->show();
+}
+
 void MainWindow::on_actionOpen_triggered()
+{
+    // several files are the rotations of one log, e.g. kern.log.2.gz kern.log.1 kern.log
+    QStringList paths = QFileDialog::getOpenFileNames();
+    qDebug() << paths;
+
+    if (paths.isEmpty())
+    {
+        return;
+    }
+
+    LoadRequest request;
+    request.paths = paths;
+    request.indexEnabled = m_indexEnabled;
+    open(request);
+}
+
+void MainWindow::on_actionOpenWindow_triggered()
 {
     QString path = QFileDialog::getOpenFileName();
     qDebug() << path;
@@ -53,21 +148,235 @@ void MainWindow::on_actionOpen_triggered()
         return;
     }
 
-    QFile file(path);
-    if (!file.open(QIODevice::ReadOnly))
+    bool ok = false;
+    const double from = QInputDialog::getDouble(this, tr("Open Window"), tr("From second:"),
+                                                0, 0, 1e9, 6, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    const double to = QInputDialog::getDouble(this, tr("Open Window"), tr("To second:"),
+                                              from + 10, from, 1e9, 6, &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    LoadRequest request;
+    request.paths << path;
+    request.fromTime = static_cast<int64_t>(from * 1000000);
+    request.toTime = static_cast<int64_t>(to * 1000000);
+    request.indexEnabled = m_indexEnabled;
+    open(request);
+}
+
+void MainWindow::on_actionFollow_toggled(bool checked)
+{
+    if (!checked)
+    {
+        m_follower.stop();
+        if (!m_followPath.isEmpty())
+        {
+            cancelLoad();
+        }
+        return;
+    }
+
+    QString path = QFileDialog::getOpenFileName();
+    qDebug() << path;
+
+    if (path.size() == 0)
+    {
+        ui->actionFollow->setChecked(false);
+        return;
+    }
+
+    // the follower is started by onLoadFinished()
+    m_capture.stop();
+    m_model->setRecordStopped(true);
+    m_followPath = path;
+
+    LoadRequest request;
+    request.paths << path;
+    request.follow = true;
+    startLoad(request);
+}
+
+void MainWindow::on_actionCapture_triggered()
+{
+    bool ok = false;
+    QString source = QInputDialog::getText(this, tr("Capture"),
+                                           tr("Source (/dev/kmsg, - for stdin, or a named pipe):"),
+                                           QLineEdit::Normal, "/dev/kmsg", &ok);
+    if (!ok || source.size() == 0)
+    {
+        return;
+    }
+
+    startCapture(source);
+}
+
+void MainWindow::on_actionSaveSnapshot_triggered()
+{
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Snapshot"), QString(),
+                                                tr("Task model snapshots (*.ttm)"));
+    qDebug() << path;
+
+    if (path.size() == 0)
+    {
+        return;
+    }
+    if (!path.endsWith(".ttm"))
+    {
+        path += ".ttm";
+    }
+
+    if (!m_model->save(path))
+    {
+        statusBar()->showMessage(tr("Cannot save %1").arg(path));
+        return;
+    }
+    statusBar()->showMessage(tr("Saved %1").arg(path));
+}
+
+void MainWindow::on_actionExportText_triggered()
+{
+    exportText(TextTreeStyle());
+}
+
+void MainWindow::on_actionExportCompactText_triggered()
+{
+    bool ok = false;
+    TextTreeStyle style;
+    style.compact = true;
+    style.maxLevels = QInputDialog::getInt(this, tr("Export Compact Text Tree"),
+                                           tr("Levels of ancestor columns shown, 0 for all:"),
+                                           0, 0, 1000, 1, &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    exportText(style);
+}
+
+void MainWindow::on_lineEditFind_returnPressed()
+{
+    const QString text = ui->lineEditFind->text();
+    if (text.isEmpty())
+    {
+        return;
+    }
+
+    const bool backward = (QApplication::keyboardModifiers() & Qt::ShiftModifier) != 0;
+    if (!ui->textTreeView->find(text, backward))
+    {
+        statusBar()->showMessage(tr("%1 not found").arg(text));
+        return;
+    }
+    statusBar()->clearMessage();
+}
+
+void MainWindow::onLoadProgress(const QString &stage, int percent)
+{
+    if (!m_loader.isRunning())
     {
-        qDebug() << file.errorString();
         return;
     }
+    m_loadProgress->setFormat(stage + " %p%");
+    m_loadProgress->setValue(percent);
+}
 
-    QString s = file.readAll();
+void MainWindow::onLoadFinished(const LoadResult &result)
+{
+    m_loadProgress->hide();
+    m_loadCancel->hide();
 
-    DmesgParser dp(m_model);
-    dp.parse(s);
+    const QString followPath = m_followPath;
+    m_followPath.clear();
 
-    TextLayouter tl(m_model);
+    if (!result.ok)
+    {
+        if (!followPath.isEmpty())
+        {
+            ui->actionFollow->setChecked(false);
+        }
+        statusBar()->showMessage(tr("Cannot open the file"));
+        return;
+    }
 
-    ui->textBrowser->setText(tl.layout());
+    // the follower and the capture keep referring to m_model
+    m_model->swap(*result.model);
+
+    ui->textTreeView->setModel(m_model, result.index);
+    m_treeModel.setModel(m_model);
+    ui->widgetTimeline->setModel(m_model);
+
+    if (!followPath.isEmpty() && !m_follower.start(followPath, result.followOffset))
+    {
+        ui->actionFollow->setChecked(false);
+    }
+}
+
+void MainWindow::onModelUpdated(int firstNewId)
+{
+    const std::vector<int> stopped = m_model->takeStopped();
+    if (firstNewId == 0)
+    {
+        updateViews();
+        return;
+    }
+
+    ui->textTreeView->updateLines(firstNewId);
+    m_treeModel.updateTasks(firstNewId, stopped);
+    ui->widgetTimeline->appendTasks(firstNewId, stopped);
+}
+
+void MainWindow::onRecordsLost(quint64 count)
+{
+    m_lostRecords += count;
+    qDebug() << "kernel ring buffer overwrote" << count << "records";
+    statusBar()->showMessage(tr("%1 records lost, the kernel ring buffer overwrote them").arg(m_lostRecords));
+}
+
+void MainWindow::cancelLoad()
+{
+    m_loader.cancel();
+    m_loadProgress->hide();
+    m_loadCancel->hide();
+
+    if (!m_followPath.isEmpty())
+    {
+        m_followPath.clear();
+        ui->actionFollow->setChecked(false);
+    }
+}
+
+void MainWindow::exportText(const TextTreeStyle &style)
+{
+    QString path = QFileDialog::getSaveFileName(this, tr("Export Text Tree"), QString(),
+                                                tr("Text files (*.txt)"));
+    qDebug() << path;
+
+    if (path.size() == 0)
+    {
+        return;
+    }
+
+    TextLayouter tl(*m_model);
+    tl.setStyle(style);
+    if (!tl.layoutToFile(path))
+    {
+        statusBar()->showMessage(tr("Cannot write %1").arg(path));
+        return;
+    }
+    statusBar()->showMessage(tr("Exported %1").arg(path));
+}
+
+void MainWindow::updateViews()
+{
+    ui->textTreeView->setModel(m_model);
+    m_treeModel.setModel(m_model);
     ui->widgetTimeline->setModel(m_model);
 }
 
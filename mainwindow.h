@@ -25,9 +25,17 @@
 #pragma once
 
 #include "taskmodel.h"
+#include "logfollower.h"
+#include "modelloader.h"
+#include "streamsource.h"
+#include "tasktreemodel.h"
+#include "texttreeindex.h"
 
 #include <QMainWindow>
 
+class QProgressBar;
+class QToolButton;
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -40,10 +48,54 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Load in the background, the views show the new model when it is
+    // ready. A load running is cancelled.
+    void open(const LoadRequest &request);
+
+    // keep a sidecar time index next to the logs opened from the menu
+    void setIndexEnabled(bool enabled);
+
+    // "/dev/kmsg", "-" for stdin, or the path of a named pipe
+    void startCapture(const QString &source);
+
+    // memory budget of the timeline tiles in KiB
+    void setTileCacheSize(int kilobytes);
+
 private slots:
     void on_actionOpen_triggered();
+    void on_actionOpenWindow_triggered();
+    void on_actionFollow_toggled(bool checked);
+    void on_actionCapture_triggered();
+    void on_actionSaveSnapshot_triggered();
+    void on_actionExportText_triggered();
+    void on_actionExportCompactText_triggered();
+    void on_lineEditFind_returnPressed();
+
+    void onLoadProgress(const QString &stage, int percent);
+    void onLoadFinished(const LoadResult &result);
+    void onModelUpdated(int firstNewId);
+    void onRecordsLost(quint64 count);
+
+private:
+    void updateViews();
+    void startLoad(const LoadRequest &request);
+    void cancelLoad();
+    void exportText(const TextTreeStyle &style);
 
 private:
     Ui::MainWindow *ui;
-    TaskModel m_model;
+    // the views share it, the sources below extend it
+    TaskModelPtr m_model;
+    LogFollower m_follower;
+    StreamSource m_capture;
+    // builds a new model which is swapped into m_model
+    ModelLoader m_loader;
+    // the log to follow once m_loader has loaded it
+    QString m_followPath;
+    // the rows of the Tree tab, created as they are expanded
+    TaskTreeModel m_treeModel;
+    QProgressBar *m_loadProgress;
+    QToolButton *m_loadCancel;
+    quint64 m_lostRecords;
+    bool m_indexEnabled;
 };
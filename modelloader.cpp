@@ -0,0 +1,167 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "modelloader.h"
+#include "dmesgparser.h"
+#include "logmerger.h"
+
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+ModelLoader::ModelLoader(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_running(false)
+{
+    // a cancelled load may still be unwinding when the next one starts
+    m_pool.setMaxThreadCount(2);
+}
+
+ModelLoader::~ModelLoader()
+{
+    // the workers emit our signals
+    cancel();
+    m_pool.waitForDone();
+}
+
+void ModelLoader::start(const LoadRequest &request)
+{
+    cancel();
+
+    m_cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_generation++;
+    m_running = true;
+
+    const quint64 generation = m_generation;
+    QFutureWatcher<LoadResult> *watcher = new QFutureWatcher<LoadResult>(this);
+    connect(watcher, &QFutureWatcher<LoadResult>::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        if (generation != m_generation || !m_running)
+        {
+            return;
+        }
+        m_running = false;
+        emit finished(watcher->result());
+    });
+
+    std::shared_ptr<std::atomic<bool>> cancelled = m_cancelled;
+    watcher->setFuture(QtConcurrent::run(&m_pool, [this, request, cancelled]() {
+        return load(request, cancelled);
+    }));
+}
+
+void ModelLoader::cancel()
+{
+    if (m_cancelled)
+    {
+        *m_cancelled = true;
+    }
+    m_running = false;
+}
+
+bool ModelLoader::isRunning() const
+{
+    return m_running;
+}
+
+bool ModelLoader::parse(TaskModel &model, const LoadRequest &request, const ProgressCallback &progress)
+{
+    if (request.paths.isEmpty())
+    {
+        return false;
+    }
+
+    const QString &path = request.paths[0];
+    const bool windowed = request.fromTime > 0 || request.toTime >= 0;
+    if (windowed && (request.paths.size() > 1 || LogMerger::isCompressed(path) || TaskModel::isSnapshot(path)))
+    {
+        qDebug() << "a time window needs a single uncompressed log:" << request.paths;
+        return false;
+    }
+    if (request.paths.size() == 1 && TaskModel::isSnapshot(path))
+    {
+        return model.load(path);
+    }
+
+    DmesgParser dp(model);
+    dp.setIndexEnabled(request.indexEnabled);
+    dp.setProgressCallback(progress);
+    if (request.paths.size() > 1 || LogMerger::isCompressed(path))
+    {
+        return dp.parseFiles(request.paths);
+    }
+    if (request.toTime >= 0)
+    {
+        return dp.parseFileWindow(path, request.fromTime, request.toTime);
+    }
+    return request.fromTime > 0 ? dp.parseFileFrom(path, request.fromTime) : dp.parseFile(path);
+}
+
+LoadResult ModelLoader::load(const LoadRequest &request, const std::shared_ptr<std::atomic<bool>> &cancelled)
+{
+    LoadResult result;
+    result.model = std::make_shared<TaskModel>();
+
+    QString stage = tr("Parsing");
+    int lastPercent = -1;
+    const ProgressCallback progress = [this, cancelled, &stage, &lastPercent](qint64 done, qint64 total) {
+        if (*cancelled)
+        {
+            return false;
+        }
+        const int percent = total > 0 ? static_cast<int>(qBound<qint64>(0, done * 100 / total, 100)) : 0;
+        if (percent != lastPercent)
+        {
+            lastPercent = percent;
+            emit progressChanged(stage, percent);
+        }
+        return true;
+    };
+
+    progress(0, 1);
+    bool parsed = false;
+    if (request.follow)
+    {
+        DmesgParser dp(*result.model);
+        dp.setProgressCallback(progress);
+        parsed = dp.parseFileLines(request.paths.value(0), result.followOffset);
+    }
+    else
+    {
+        parsed = parse(*result.model, request, progress);
+    }
+    if (!parsed || *cancelled)
+    {
+        return result;
+    }
+
+    stage = tr("Indexing");
+    lastPercent = -1;
+    progress(0, 1);
+    result.index = std::make_shared<TextTreeIndex>();
+    result.ok = result.index->build(result.model.get(), progress) && !*cancelled;
+    return result;
+}
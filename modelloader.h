@@ -0,0 +1,104 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include "progress.h"
+#include "taskmodel.h"
+#include "texttreeindex.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <atomic>
+#include <memory>
+
+// What to load into a model
+struct LoadRequest
+{
+    LoadRequest() : fromTime(0), toTime(-1), indexEnabled(false), follow(false) {}
+
+    // a snapshot, a log, or rotated logs which are merged by timestamp
+    QStringList paths;
+    // microsecond, a single log is read from the indexed line before
+    // fromTime, and cropped to [fromTime, toTime] if toTime is not -1.
+    // They are rejected for a snapshot, or rotated or compressed logs.
+    int64_t fromTime;
+    int64_t toTime;
+    // build the sidecar index of a log, see LogIndex
+    bool indexEnabled;
+    // a single log which is still growing, only its terminated lines
+    // are parsed, see LoadResult::followOffset
+    bool follow;
+};
+
+struct LoadResult
+{
+    LoadResult() : ok(false), followOffset(0) {}
+
+    bool ok;
+    std::shared_ptr<TaskModel> model;
+    // the lines of the text tree of model, see TextTreeView::setModel()
+    std::shared_ptr<TextTreeIndex> index;
+    // bytes of a followed log in model, see LogFollower::start()
+    qint64 followOffset;
+};
+
+// Loads a model on a worker thread: read and parse the files into a new
+// TaskModel, and index the lines of its text tree. Starting a load
+// cancels the one running, and the result is handed over on the GUI
+// thread.
+class ModelLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModelLoader(QObject *parent = nullptr);
+    ~ModelLoader() override;
+
+    void start(const LoadRequest &request);
+    void cancel();
+    bool isRunning() const;
+
+    // the parse stage on the calling thread, e.g. for a batch conversion
+    static bool parse(TaskModel &model, const LoadRequest &request, const ProgressCallback &progress = ProgressCallback());
+
+signals:
+    // emitted by the worker thread, so a connection to a widget is queued
+    void progressChanged(const QString &stage, int percent);
+    // not emitted for a cancelled load
+    void finished(const LoadResult &result);
+
+private:
+    LoadResult load(const LoadRequest &request, const std::shared_ptr<std::atomic<bool>> &cancelled);
+
+private:
+    // the load running, it is set when the load is cancelled
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
+    quint64 m_generation;
+    bool m_running;
+
+    QThreadPool m_pool;
+};
@@ -0,0 +1,346 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "streamsource.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+// publish a batch once it holds this many lines or is this old
+const int BATCH_LINES = 4096;
+const qint64 BATCH_INTERVAL_MS = 100;
+
+const int POLL_TIMEOUT_MS = 50;
+
+// one read() of /dev/kmsg returns one whole record, which must fit
+const size_t READ_BUFFER_SIZE = 8192;
+
+QString errnoString()
+{
+    return QString::fromLocal8Bit(strerror(errno));
+}
+
+}
+
+StreamReader::StreamReader(int fd, bool closeFd, bool keepOpenOnEof, Format format, QObject *parent)
+    : QThread(parent)
+    , m_fd(fd)
+    , m_closeFd(closeFd)
+    , m_keepOpenOnEof(keepOpenOnEof)
+    , m_format(format)
+    , m_lineCount(0)
+    , m_seqValid(false)
+    , m_lastSeq(0)
+    , m_originalFlags(::fcntl(fd, F_GETFL))
+{
+    if (m_originalFlags != -1)
+    {
+        ::fcntl(m_fd, F_SETFL, m_originalFlags | O_NONBLOCK);
+    }
+}
+
+StreamReader::~StreamReader()
+{
+    requestInterruption();
+    wait();
+
+    if (m_closeFd)
+    {
+        ::close(m_fd);
+    }
+    else if (m_originalFlags != -1)
+    {
+        // e.g. stdin, which is shared with the shell
+        ::fcntl(m_fd, F_SETFL, m_originalFlags);
+    }
+}
+
+void StreamReader::run()
+{
+    QByteArray pending;
+    char buffer[READ_BUFFER_SIZE];
+
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+
+    bool eof = false;
+    while (!eof && !isInterruptionRequested())
+    {
+        pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        const int ready = ::poll(&pfd, 1, POLL_TIMEOUT_MS);
+        if (ready < 0 && errno != EINTR)
+        {
+            emit readError(errnoString());
+            break;
+        }
+
+        // drain what is available, but publish in between long bursts
+        while (ready > 0 && m_lineCount < BATCH_LINES)
+        {
+            const ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+            if (n > 0)
+            {
+                pending.append(buffer, static_cast<int>(n));
+                takeLines(pending);
+                continue;
+            }
+
+            if (n == 0)
+            {
+                if (m_keepOpenOnEof)
+                {
+                    // a named pipe whose writer went away, wait for the next one
+                    QThread::msleep(POLL_TIMEOUT_MS);
+                }
+                else
+                {
+                    eof = true;
+                }
+                break;
+            }
+
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EPIPE)
+            {
+                // /dev/kmsg: the record we were about to read has been
+                // overwritten, the sequence number gap tells how many
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                emit readError(errnoString());
+                eof = true;
+            }
+            break;
+        }
+
+        if (m_lineCount >= BATCH_LINES
+                || (m_lineCount > 0 && sinceFlush.elapsed() >= BATCH_INTERVAL_MS))
+        {
+            flush();
+            sinceFlush.restart();
+        }
+    }
+
+    // the last line is complete once the stream has ended
+    if (eof && !pending.isEmpty())
+    {
+        pending.append('\n');
+        takeLines(pending);
+    }
+    flush();
+}
+
+void StreamReader::takeLines(QByteArray &pending)
+{
+    int complete = pending.size();
+    while (complete > 0 && pending.at(complete - 1) != '\n')
+    {
+        complete--;
+    }
+    if (complete == 0)
+    {
+        return;
+    }
+
+    m_lineCount += static_cast<int>(std::count(pending.constData(), pending.constData() + complete, '\n'));
+    m_text.append(pending.constData(), complete);
+    pending.remove(0, complete);
+}
+
+void StreamReader::flush()
+{
+    if (m_text.isEmpty())
+    {
+        return;
+    }
+
+    std::shared_ptr<DmesgEventBatch> batch = std::make_shared<DmesgEventBatch>();
+    batch->text.swap(m_text);
+    m_lineCount = 0;
+
+    tokenize(*batch);
+
+    if (!batch->events.empty() || batch->malformedLines > 0)
+    {
+        emit batchReady(batch);
+    }
+}
+
+void StreamReader::tokenize(DmesgEventBatch &batch)
+{
+    const char *p = batch.text.constData();
+    const char *end = p + batch.text.size();
+    while (p < end)
+    {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char *lineEnd = eol ? eol : end;
+
+        quint64 seq = 0;
+        int64_t time = 0;
+        const char *message = nullptr;
+
+        if (m_format == Auto && lineEnd > p)
+        {
+            m_format = DmesgParser::parseKmsgHeader(p, lineEnd, seq, time, message) ? Kmsg : Text;
+        }
+
+        DmesgEvent event;
+        if (m_format == Kmsg)
+        {
+            // continuation lines (" SUBSYSTEM=...") start with a space
+            if (p < lineEnd && *p != ' ' && DmesgParser::parseKmsgHeader(p, lineEnd, seq, time, message))
+            {
+                if (m_seqValid && seq > m_lastSeq + 1)
+                {
+                    emit recordsLost(seq - m_lastSeq - 1);
+                }
+                m_seqValid = true;
+                m_lastSeq = seq;
+
+                if (DmesgParser::tokenizeMessage(time, message, lineEnd, event, &batch.malformedLines))
+                {
+                    batch.events.push_back(event);
+                }
+            }
+        }
+        else if (DmesgParser::tokenizeLine(p, lineEnd, event, &batch.malformedLines))
+        {
+            batch.events.push_back(event);
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+StreamSource::StreamSource(TaskModel &model, QObject *parent)
+    : QObject(parent)
+    , m_model(model)
+    , m_parser(model)
+    , m_reader(nullptr)
+{
+    qRegisterMetaType<DmesgEventBatchPtr>("DmesgEventBatchPtr");
+}
+
+StreamSource::~StreamSource()
+{
+    stop();
+}
+
+bool StreamSource::start(const QString &source)
+{
+    stop();
+
+    int fd = STDIN_FILENO;
+    bool closeFd = false;
+    bool keepOpenOnEof = false;
+    StreamReader::Format format = StreamReader::Auto;
+
+    if (source != "-")
+    {
+        fd = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+        {
+            qDebug() << "open failed:" << source << errnoString();
+            return false;
+        }
+        closeFd = true;
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+        {
+            keepOpenOnEof = S_ISFIFO(st.st_mode);
+            if (S_ISCHR(st.st_mode))
+            {
+                // only /dev/kmsg makes sense here
+                format = StreamReader::Kmsg;
+            }
+        }
+    }
+
+    m_model.clear();
+
+    m_reader = new StreamReader(fd, closeFd, keepOpenOnEof, format, this);
+    connect(m_reader, &StreamReader::batchReady, this, &StreamSource::onBatchReady);
+    connect(m_reader, &StreamReader::recordsLost, this, &StreamSource::recordsLost);
+    connect(m_reader, &StreamReader::readError, this, [source](const QString &error) {
+        qDebug() << "read failed:" << source << error;
+    });
+    connect(m_reader, &QThread::finished, this, &StreamSource::onReaderFinished);
+    m_reader->start();
+
+    emit modelUpdated(0);
+    return true;
+}
+
+void StreamSource::stop()
+{
+    if (m_reader)
+    {
+        m_reader->disconnect(this);
+        delete m_reader;
+        m_reader = nullptr;
+
+        // drop batches which are still queued from the stopped reader
+        QCoreApplication::removePostedEvents(this, QEvent::MetaCall);
+    }
+}
+
+bool StreamSource::isCapturing() const
+{
+    return m_reader && m_reader->isRunning();
+}
+
+void StreamSource::onBatchReady(DmesgEventBatchPtr batch)
+{
+    const int firstNewId = m_model.taskCount();
+    m_parser.appendEvents(batch->events, batch->malformedLines);
+    emit modelUpdated(firstNewId);
+}
+
+void StreamSource::onReaderFinished()
+{
+    emit finished();
+}
@@ -0,0 +1,124 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include "dmesgparser.h"
+
+#include <QObject>
+#include <QThread>
+#include <QByteArray>
+
+#include <memory>
+#include <vector>
+
+// Events tokenized by the capture thread. comm of every event points
+// into text, which is never modified once the batch is published.
+struct DmesgEventBatch
+{
+    DmesgEventBatch() : malformedLines(0) {}
+
+    QByteArray text;
+    std::vector<DmesgEvent> events;
+    int malformedLines;
+};
+
+typedef std::shared_ptr<const DmesgEventBatch> DmesgEventBatchPtr;
+
+Q_DECLARE_METATYPE(DmesgEventBatchPtr)
+
+// Read kernel log records from a file descriptor on a background
+// thread and publish them in batches.
+class StreamReader : public QThread
+{
+    Q_OBJECT
+public:
+    enum Format
+    {
+        Auto,
+        Text,   // "[    4.070211] FORK|..." as written by dmesg(1) or syslog
+        Kmsg    // "6,339,4070211,-;FORK|..." as read from /dev/kmsg
+    };
+
+    StreamReader(int fd, bool closeFd, bool keepOpenOnEof, Format format, QObject *parent = nullptr);
+    ~StreamReader() override;
+
+signals:
+    void batchReady(DmesgEventBatchPtr batch);
+    // sequence numbers skipped by /dev/kmsg, the ring buffer overwrote them
+    void recordsLost(quint64 count);
+    void readError(const QString &error);
+
+protected:
+    void run() override;
+
+private:
+    void takeLines(QByteArray &pending);
+    void flush();
+    void tokenize(DmesgEventBatch &batch);
+
+private:
+    int m_fd;
+    bool m_closeFd;
+    bool m_keepOpenOnEof;
+    Format m_format;
+
+    QByteArray m_text;
+    int m_lineCount;
+    bool m_seqValid;
+    quint64 m_lastSeq;
+
+    int m_originalFlags;
+};
+
+// Capture fork/exec/exit records from /dev/kmsg, stdin or a named pipe
+// and extend a TaskModel while they arrive.
+class StreamSource : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StreamSource(TaskModel &model, QObject *parent = nullptr);
+    ~StreamSource() override;
+
+    // "/dev/kmsg", "-" for stdin, or the path of a named pipe
+    bool start(const QString &source);
+    void stop();
+
+    bool isCapturing() const;
+
+signals:
+    // the model has been extended, tasks from firstNewId on are new
+    void modelUpdated(int firstNewId);
+    void recordsLost(quint64 count);
+    void finished();
+
+private slots:
+    void onBatchReady(DmesgEventBatchPtr batch);
+    void onReaderFinished();
+
+private:
+    TaskModel &m_model;
+    DmesgParser m_parser;
+    StreamReader *m_reader;
+};
@@ -23,20 +23,20 @@
  ********************************************************************************/
 
 #include "task.h"
+#include "taskmodel.h"
 
-Task::Task(Type t, int id, int pid, const QString &comm, int64_t startTime, bool kthread)
-    : m_type(t)
+#include <assert.h>
+
+Task::Task(const TaskModel *model, int id)
+    : m_model(model)
     , m_id(id)
-    , m_pid(pid)
-    , m_comm(comm)
-    , m_startTime(startTime)
-    , m_stopTime(-1)
-    , m_parentId(-1)
-    , m_preExecId(-1)
-    , m_postExecId(-1)
-    , m_kthread(kthread)
 {
+    assert(m_model);
+}
 
+Task::Type Task::type() const
+{
+    return m_model->type(m_id);
 }
 
 int Task::id() const
@@ -46,89 +46,119 @@ int Task::id() const
 
 int Task::pid() const
 {
-    return m_pid;
+    return m_model->pid(m_id);
 }
 
-QString Task::comm() const
+int Task::commId() const
 {
-    return m_comm;
+    return m_model->commId(m_id);
 }
 
-int64_t Task::startTime() const
+const QString &Task::comm() const
 {
-    return m_startTime;
+    return m_model->comm(m_id);
 }
 
-int64_t Task::stopTime() const
+int64_t Task::startTime() const
 {
-    return m_stopTime;
+    return m_model->startTime(m_id);
 }
 
-void Task::setStopTime(const int64_t &stopTime)
+int64_t Task::stopTime() const
 {
-    m_stopTime = stopTime;
+    return m_model->stopTime(m_id);
 }
 
 int Task::parentId() const
 {
-    return m_parentId;
+    return m_model->parentId(m_id);
 }
 
-void Task::setParentId(int parentId)
+int Task::preExecId() const
 {
-    m_parentId = parentId;
+    return m_model->preExecId(m_id);
 }
 
 int Task::postExecId() const
 {
-    return m_postExecId;
+    return m_model->postExecId(m_id);
+}
+
+IdSpan Task::children() const
+{
+    return m_model->children(m_id);
+}
+
+bool Task::kthread() const
+{
+    return m_model->kthread(m_id);
+}
+
+bool Task::startClamped() const
+{
+    return m_model->startClamped(m_id);
 }
 
-void Task::setPostExecId(int afterExecId)
+bool Task::stopClamped() const
 {
-    m_postExecId = afterExecId;
+    return m_model->stopClamped(m_id);
 }
 
-void Task::addChild(int id)
+int Task::childrenId(int i) const
 {
-    m_childrenId.push_back(id);
+    return m_model->childId(m_id, i);
 }
 
-std::vector<int> Task::childrenId() const
+int Task::childrenCount() const
 {
-    return m_childrenId;
+    return m_model->childrenCount(m_id);
 }
 
 int64_t Task::duration() const
 {
     int64_t result = -1;
-    if (m_stopTime != -1)
+    const int64_t stop = stopTime();
+    if (stop != -1)
     {
-        result = m_stopTime - m_startTime;
+        result = stop - startTime();
     }
     return result;
 }
 
 QString Task::description() const
 {
-    QString result = QString("[%1] %2").arg(pid()).arg(comm());
-    if (duration() == -1)
+    // the same as QString("[%1] %2").arg(pid()).arg(comm()), it is
+    // called for every task by the views
+    const QString &comm = this->comm();
+
+    QString result;
+    result.reserve(comm.size() + 24);
+    result += QLatin1Char('[');
+    result += QString::number(pid());
+    result += QLatin1String("] ");
+    result += comm;
+    if (startClamped())
+    {
+        result += QLatin1String("(started before)");
+    }
+    if (duration() == -1 || stopClamped())
     {
-        result += "(living)";
+        result += QLatin1String("(living)");
     }
     return result;
 }
 
 QString Task::dump() const
 {
+    const IdSpan childrenId = this->children();
+
     QString children = "(";
-    if (m_childrenId.size() != 0)
+    if (!childrenId.empty())
     {
-        children += QString::number(m_childrenId[0]);
-        const size_t size = m_childrenId.size();
-        for (size_t i = 1; i < size; i++)
+        children += QString::number(childrenId[0]);
+        for (int i = 1; i < childrenId.size(); i++)
         {
-            children += ", " + QString::number(m_childrenId[i]);
+            children += ", " + QString::number(childrenId[i]);
         }
     }
     children += ")";
@@ -137,23 +167,8 @@ QString Task::dump() const
                    "startTime: %5, stopTime: %6, "
                    "parentId: %7, preExecId: %8, postExecId: %9, "
                    "children: %10")
-            .arg(m_type).arg(m_id).arg(m_pid).arg(m_comm)
-            .arg(m_startTime).arg(m_stopTime)
-            .arg(m_parentId).arg(m_preExecId).arg(m_postExecId)
+            .arg(type()).arg(m_id).arg(pid()).arg(comm())
+            .arg(startTime()).arg(stopTime())
+            .arg(parentId()).arg(preExecId()).arg(postExecId())
             .arg(children);
 }
-
-bool Task::kthread() const
-{
-    return m_kthread;
-}
-
-int Task::preExecId() const
-{
-    return m_preExecId;
-}
-
-void Task::setPreExecId(int preExecId)
-{
-    m_preExecId = preExecId;
-}
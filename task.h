@@ -26,9 +26,30 @@
 
 #include <QString>
 
-#include <vector>
-#include <memory>
+#include <stdint.h>
 
+class TaskModel;
+
+// A read-only view of ids stored consecutively in a TaskModel
+class IdSpan
+{
+public:
+    IdSpan(const int *begin, const int *end) : m_begin(begin), m_end(end) {}
+
+    const int *begin() const { return m_begin; }
+    const int *end() const { return m_end; }
+    int size() const { return static_cast<int>(m_end - m_begin); }
+    bool empty() const { return m_begin == m_end; }
+    int operator[](int i) const { return m_begin[i]; }
+
+private:
+    const int *m_begin;
+    const int *m_end;
+};
+
+// A handle to a task of a TaskModel. The model stores the tasks column
+// by column, a Task only remembers where to look. It is cheap to copy
+// and valid as long as the model is.
 class Task
 {
 public:
@@ -40,53 +61,33 @@ public:
     };
 
 public:
-    Task(Type t, int id, int pid, const QString &comm, int64_t startTime, bool kthread);
+    Task(const TaskModel *model, int id);
 
+    Type type() const;
     int id() const;
     int pid() const;
-    QString comm() const;
+    int commId() const;
+    const QString &comm() const;
     int64_t startTime() const;
     int64_t stopTime() const;
     int parentId() const;
     int preExecId() const;
     int postExecId() const;
-    std::vector<int> childrenId() const;
+    IdSpan children() const;
     bool kthread() const;
+    // the times are clamped to the time window the model was loaded with
+    bool startClamped() const;
+    bool stopClamped() const;
 
-    int childrenId(int i) const { assert(i < childrenCount()); return m_childrenId[static_cast<size_t>(i)]; }
-    int childrenCount() const { return static_cast<int>(m_childrenId.size()); }
+    int childrenId(int i) const;
+    int childrenCount() const;
 
-    void setStopTime(const int64_t &stopTime);
-    void setParentId(int parentId);
-    void setPreExecId(int preExecId);
-    void setPostExecId(int postExecId);
-
-    void addChild(int id);
     int64_t duration() const;
 
     QString description() const;
     QString dump() const;
 
 private:
-    Type m_type;
-
-    // pid is unique only in living task. It can be duplicated
-    // with a history task. So we need a id field.
+    const TaskModel *m_model;
     int m_id;
-    int m_pid;
-
-    QString m_comm;
-
-    // microsecond from system boot
-    int64_t m_startTime;
-    int64_t m_stopTime;
-
-    // it is NOT the pid
-    int m_parentId;
-    int m_preExecId;
-    int m_postExecId;
-    std::vector<int> m_childrenId;
-
-    bool m_kthread;
 };
-
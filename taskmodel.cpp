@@ -25,12 +25,143 @@
 #include "taskmodel.h"
 
 #include <QDebug>
+#include <QSaveFile>
 
-#include <assert.h>
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
 
 using namespace std;
 
+namespace
+{
+
+// the largest pid_max of Linux, a larger pid comes from a broken record
+const int PID_MAX_LIMIT = 4 * 1024 * 1024;
+
+// "TaskTree Model", the version follows in the header
+const char SNAPSHOT_MAGIC[8] = {'T', 'T', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+// every column starts at a multiple of it, so it can be used in place
+const uint64_t COLUMN_ALIGNMENT = 8;
+
+enum ColumnId : uint32_t
+{
+    START_TIME_COLUMN = 1,
+    STOP_TIME_COLUMN,
+    PID_COLUMN,
+    PARENT_ID_COLUMN,
+    PRE_EXEC_ID_COLUMN,
+    POST_EXEC_ID_COLUMN,
+    FLAGS_COLUMN,
+    COMM_ID_COLUMN,
+    COMM_HASH_COLUMN,
+    COMM_BYTES_COLUMN,
+    COMM_OFFSET_COLUMN,
+    CHILDREN_OFFSET_COLUMN,
+    CHILDREN_COLUMN,
+    PID_TO_ID_COLUMN,
+    PREV_PID_ID_COLUMN
+};
+
+// The file is the header, the column table and then the columns. All
+// the integers are little-endian.
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint64_t taskCount;
+    uint64_t commCount;
+};
+
+struct ColumnEntry
+{
+    uint32_t id;
+    uint32_t elementSize;
+    // from the start of the file
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct ColumnRef
+{
+    uint32_t id;
+    uint32_t elementSize;
+    const void *data;
+    uint64_t count;
+};
+
+struct SnapshotView
+{
+    const uchar *data;
+    uint64_t size;
+    const ColumnEntry *entries;
+    uint32_t columnCount;
+};
+
+const uint64_t ANY_COUNT = numeric_limits<uint64_t>::max();
+
+uint64_t alignColumn(uint64_t offset)
+{
+    return (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+}
+
+template <typename T>
+ColumnRef columnRef(ColumnId id, const Column<T> &column)
+{
+    ColumnRef result = {id, sizeof(T), column.data(), column.size()};
+    return result;
+}
+
+template <typename T>
+bool mapColumn(const SnapshotView &view, ColumnId id, uint64_t count, Column<T> &column)
+{
+    for (uint32_t i = 0; i < view.columnCount; i++)
+    {
+        const ColumnEntry &entry = view.entries[i];
+        if (entry.id != id)
+        {
+            continue;
+        }
+
+        if (entry.elementSize != sizeof(T) || (count != ANY_COUNT && entry.count != count)
+                || entry.offset % COLUMN_ALIGNMENT != 0 || entry.offset > view.size
+                || entry.count > (view.size - entry.offset) / sizeof(T))
+        {
+            qDebug() << "column" << id << "does not fit";
+            return false;
+        }
+
+        column.map(view.data + entry.offset, static_cast<size_t>(entry.count));
+        return true;
+    }
+
+    qDebug() << "column" << id << "is missing";
+    return false;
+}
+
+uint32_t fnv1a(const char *data, int size)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+}
+
 TaskModel::TaskModel()
+    : m_recordStopped(false)
+    , m_unknownParentCount(0)
+    , m_unknownExecCount(0)
+    , m_unknownExitCount(0)
+    , m_unindexedPidCount(0)
 {
     addIdleTask();
 }
@@ -42,80 +173,563 @@ TaskModel::~TaskModel()
 
 void TaskModel::clear()
 {
-    m_tasks.clear();
-    m_pid2id.clear();
+    m_startTime.clear();
+    m_stopTime.clear();
+    m_pid.clear();
+    m_parentId.clear();
+    m_preExecId.clear();
+    m_postExecId.clear();
+    m_flags.clear();
+    m_commId.clear();
+    m_commNames.clear();
+    m_commHash.clear();
+    m_commBytes.clear();
+    m_commOffset.clear();
+    m_commTable.clear();
+    m_childrenOffset.clear();
+    m_children.clear();
+    m_lateChildren.clear();
+    m_pidToId.clear();
+    m_prevPidId.clear();
+    m_stopped.clear();
+    m_file.reset();
+    m_unknownParentCount = 0;
+    m_unknownExecCount = 0;
+    m_unknownExitCount = 0;
+    m_unindexedPidCount = 0;
 
     addIdleTask();
 }
 
-void TaskModel::addForkTask(int pid, int ppid, const QString &comm, int64_t startTime, bool kthread)
+void TaskModel::swap(TaskModel &other)
 {
-    // qDebug() << pid << ppid << comm << startTime;
+    m_startTime.swap(other.m_startTime);
+    m_stopTime.swap(other.m_stopTime);
+    m_pid.swap(other.m_pid);
+    m_parentId.swap(other.m_parentId);
+    m_preExecId.swap(other.m_preExecId);
+    m_postExecId.swap(other.m_postExecId);
+    m_flags.swap(other.m_flags);
+    m_commId.swap(other.m_commId);
 
-    if (pid == 0)
+    m_commNames.swap(other.m_commNames);
+    m_commHash.swap(other.m_commHash);
+    m_commBytes.swap(other.m_commBytes);
+    m_commOffset.swap(other.m_commOffset);
+    m_commTable.swap(other.m_commTable);
+
+    m_childrenOffset.swap(other.m_childrenOffset);
+    m_children.swap(other.m_children);
+    m_lateChildren.swap(other.m_lateChildren);
+
+    m_pidToId.swap(other.m_pidToId);
+    m_prevPidId.swap(other.m_prevPidId);
+
+    m_file.swap(other.m_file);
+
+    m_stopped.clear();
+    other.m_stopped.clear();
+}
+
+bool TaskModel::isSnapshot(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
     {
-        qDebug() << "ignore idle task:" << pid << ppid << comm << startTime;
-        return;
+        return false;
+    }
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    return file.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+bool TaskModel::save(const QString &path) const
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    qDebug() << "snapshots are little-endian, cannot save on this host:" << path;
+    return false;
+#else
+    if (m_childrenOffset.size() != m_startTime.size() + 1)
+    {
+        qDebug() << "model is not finalized, cannot save:" << path;
+        return false;
+    }
+
+    // the late children are folded into the CSR arrays of the file
+    const Column<int> *childrenOffset = &m_childrenOffset;
+    const Column<int> *children = &m_children;
+    Column<int> builtOffset;
+    Column<int> builtChildren;
+    if (!m_lateChildren.empty())
+    {
+        buildChildren(builtOffset, builtChildren);
+        childrenOffset = &builtOffset;
+        children = &builtChildren;
+    }
+
+    const ColumnRef columns[] =
+    {
+        columnRef(START_TIME_COLUMN, m_startTime),
+        columnRef(STOP_TIME_COLUMN, m_stopTime),
+        columnRef(PID_COLUMN, m_pid),
+        columnRef(PARENT_ID_COLUMN, m_parentId),
+        columnRef(PRE_EXEC_ID_COLUMN, m_preExecId),
+        columnRef(POST_EXEC_ID_COLUMN, m_postExecId),
+        columnRef(FLAGS_COLUMN, m_flags),
+        columnRef(COMM_ID_COLUMN, m_commId),
+        columnRef(COMM_HASH_COLUMN, m_commHash),
+        columnRef(COMM_BYTES_COLUMN, m_commBytes),
+        columnRef(COMM_OFFSET_COLUMN, m_commOffset),
+        columnRef(CHILDREN_OFFSET_COLUMN, *childrenOffset),
+        columnRef(CHILDREN_COLUMN, *children),
+        columnRef(PID_TO_ID_COLUMN, m_pidToId),
+        columnRef(PREV_PID_ID_COLUMN, m_prevPidId),
+    };
+    const uint32_t columnCount = sizeof(columns) / sizeof(columns[0]);
+
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.columnCount = columnCount;
+    header.taskCount = static_cast<uint64_t>(taskCount());
+    header.commCount = static_cast<uint64_t>(commCount());
+
+    std::vector<ColumnEntry> entries(columnCount);
+    uint64_t offset = alignColumn(sizeof(header) + sizeof(ColumnEntry) * columnCount);
+    for (uint32_t i = 0; i < columnCount; i++)
+    {
+        entries[i].id = columns[i].id;
+        entries[i].elementSize = columns[i].elementSize;
+        entries[i].offset = offset;
+        entries[i].count = columns[i].count;
+        offset = alignColumn(offset + columns[i].elementSize * columns[i].count);
     }
-    assert(m_pid2id[ppid].size() != 0);
 
-    int parentId = m_pid2id[ppid].back();
-    int id = static_cast<int>(m_tasks.size());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
 
-    m_tasks.emplace_back(Task::Fork, id, pid, comm, startTime, kthread);
-    m_pid2id[pid].push_back(id);
+    static const char PADDING[COLUMN_ALIGNMENT] = {};
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+    ok = ok && file.write(reinterpret_cast<const char *>(entries.data()), sizeof(ColumnEntry) * columnCount)
+            == static_cast<qint64>(sizeof(ColumnEntry) * columnCount);
+    for (uint32_t i = 0; ok && i < columnCount; i++)
+    {
+        const qint64 padding = static_cast<qint64>(entries[i].offset) - file.pos();
+        const qint64 size = static_cast<qint64>(columns[i].elementSize * columns[i].count);
+        ok = file.write(PADDING, padding) == padding
+                && file.write(static_cast<const char *>(columns[i].data), size) == size;
+    }
 
-    m_tasks[static_cast<size_t>(id)].setParentId(parentId);
-    m_tasks[static_cast<size_t>(parentId)].addChild(id);
+    if (!ok || !file.commit())
+    {
+        qDebug() << "cannot write snapshot:" << path << file.errorString();
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool TaskModel::load(const QString &path)
+{
+    clear();
+
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    qDebug() << "snapshots are little-endian, cannot load on this host:" << path;
+    return false;
+#else
+    std::unique_ptr<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        qDebug() << file->errorString();
+        return false;
+    }
+
+    const qint64 fileSize = file->size();
+    if (fileSize < static_cast<qint64>(sizeof(SnapshotHeader)))
+    {
+        qDebug() << "snapshot is truncated:" << path;
+        return false;
+    }
+
+    const uchar *data = file->map(0, fileSize);
+    if (!data)
+    {
+        qDebug() << "cannot map snapshot:" << path << file->errorString();
+        return false;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION)
+    {
+        qDebug() << "not a snapshot of version" << SNAPSHOT_VERSION << ":" << path;
+        return false;
+    }
+
+    const uint64_t tableEnd = sizeof(header) + sizeof(ColumnEntry) * static_cast<uint64_t>(header.columnCount);
+    if (header.taskCount == 0 || header.taskCount > static_cast<uint64_t>(numeric_limits<int>::max())
+            || header.commCount > header.taskCount || tableEnd > static_cast<uint64_t>(fileSize))
+    {
+        qDebug() << "snapshot header is broken:" << path;
+        return false;
+    }
+
+    const ColumnEntry *entries = reinterpret_cast<const ColumnEntry *>(data + sizeof(header));
+    const SnapshotView view = {data, static_cast<uint64_t>(fileSize), entries, header.columnCount};
+
+    const uint64_t taskCount = header.taskCount;
+    const uint64_t commCount = header.commCount;
+    bool ok = mapColumn(view, START_TIME_COLUMN, taskCount, m_startTime)
+            && mapColumn(view, STOP_TIME_COLUMN, taskCount, m_stopTime)
+            && mapColumn(view, PID_COLUMN, taskCount, m_pid)
+            && mapColumn(view, PARENT_ID_COLUMN, taskCount, m_parentId)
+            && mapColumn(view, PRE_EXEC_ID_COLUMN, taskCount, m_preExecId)
+            && mapColumn(view, POST_EXEC_ID_COLUMN, taskCount, m_postExecId)
+            && mapColumn(view, FLAGS_COLUMN, taskCount, m_flags)
+            && mapColumn(view, COMM_ID_COLUMN, taskCount, m_commId)
+            && mapColumn(view, COMM_HASH_COLUMN, commCount, m_commHash)
+            && mapColumn(view, COMM_OFFSET_COLUMN, commCount + 1, m_commOffset)
+            && mapColumn(view, CHILDREN_OFFSET_COLUMN, taskCount + 1, m_childrenOffset)
+            && mapColumn(view, PID_TO_ID_COLUMN, ANY_COUNT, m_pidToId)
+            && mapColumn(view, PREV_PID_ID_COLUMN, taskCount, m_prevPidId);
+    ok = ok && mapColumn(view, COMM_BYTES_COLUMN, static_cast<uint64_t>(m_commOffset.back()), m_commBytes)
+            && mapColumn(view, CHILDREN_COLUMN, static_cast<uint64_t>(m_childrenOffset.back()), m_children);
+    if (!ok || !checkSnapshot())
+    {
+        qDebug() << "snapshot columns are broken:" << path;
+        clear();
+        return false;
+    }
+
+    m_file = std::move(file);
+
+    // only the distinct comm values are decoded
+    m_commNames.clear();
+    m_commTable.clear();
+    m_commNames.reserve(static_cast<size_t>(commCount));
+    for (size_t i = 0; i < commCount; i++)
+    {
+        m_commNames.push_back(QString::fromUtf8(m_commBytes.data() + m_commOffset[i], m_commOffset[i + 1] - m_commOffset[i]));
+    }
+    growCommTable();
+
+    return true;
+#endif
+}
+
+bool TaskModel::checkSnapshot() const
+{
+    const int taskCount = this->taskCount();
+    const int commCount = static_cast<int>(m_commHash.size());
+
+    if (m_commOffset[0] != 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < commCount; i++)
+    {
+        if (m_commOffset[static_cast<size_t>(i)] > m_commOffset[static_cast<size_t>(i + 1)])
+        {
+            return false;
+        }
+    }
+
+    // the layouts walk up the parent and pre exec links, which must lead
+    // to smaller ids so the walks end
+    for (int id = 0; id < taskCount; id++)
+    {
+        const size_t i = static_cast<size_t>(id);
+        const int parentId = m_parentId[i];
+        const int preExecId = m_preExecId[i];
+        const int postExecId = m_postExecId[i];
+        const int prevPidId = m_prevPidId[i];
+        if (m_commId[i] < 0 || m_commId[i] >= commCount
+                || parentId < -1 || parentId >= id
+                || preExecId < -1 || preExecId >= id
+                || (postExecId != -1 && (postExecId <= id || postExecId >= taskCount))
+                || prevPidId < -1 || prevPidId >= id)
+        {
+            return false;
+        }
+    }
+
+    if (m_childrenOffset[0] != 0 || m_childrenOffset.back() != static_cast<int>(m_children.size()))
+    {
+        return false;
+    }
+    for (int id = 0; id < taskCount; id++)
+    {
+        const int begin = m_childrenOffset[static_cast<size_t>(id)];
+        const int end = m_childrenOffset[static_cast<size_t>(id + 1)];
+        if (begin > end)
+        {
+            return false;
+        }
+        for (int i = begin; i < end; i++)
+        {
+            const int child = m_children[static_cast<size_t>(i)];
+            // sorted, children() is searched
+            if (child <= id || child >= taskCount || m_parentId[static_cast<size_t>(child)] != id
+                    || (i > begin && child <= m_children[static_cast<size_t>(i - 1)]))
+            {
+                return false;
+            }
+        }
+    }
+
+    for (size_t pid = 0; pid < m_pidToId.size(); pid++)
+    {
+        if (m_pidToId[pid] < -1 || m_pidToId[pid] >= taskCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TaskModel::addForkTask(int pid, int ppid, const QString &comm, int64_t startTime, bool kthread)
+{
+    const QByteArray ba = comm.toUtf8();
+    addForkTask(pid, ppid, ba.constData(), ba.size(), startTime, kthread);
 }
 
 void TaskModel::addExecTask(int pid, const QString &comm, int64_t startTime)
 {
-    // qDebug() << pid << comm << startTime;
+    const QByteArray ba = comm.toUtf8();
+    addExecTask(pid, ba.constData(), ba.size(), startTime);
+}
+
+void TaskModel::addForkTask(int pid, int ppid, const char *comm, int commSize, int64_t startTime, bool kthread)
+{
+    // qDebug() << pid << ppid << QByteArray(comm, commSize) << startTime;
+
+    if (pid == 0)
+    {
+        qDebug() << "ignore idle task:" << pid << ppid << QByteArray(comm, commSize) << startTime;
+        return;
+    }
+    // a capture can start long after boot, so the parent may never have been seen
+    int parentId = currentId(ppid);
+    if (parentId == -1)
+    {
+        m_unknownParentCount++;
+        parentId = 0;
+    }
+    int id = appendTask(Task::Fork, pid, comm, commSize, startTime, kthread);
 
-    assert(m_pid2id[pid].size() != 0);
+    m_parentId.ref(static_cast<size_t>(id)) = parentId;
+}
 
-    int id = static_cast<int>(m_tasks.size());
-    int preExecId = m_pid2id[pid].back();
-    bool kthread = task(preExecId).kthread();
+void TaskModel::addExecTask(int pid, const char *comm, int commSize, int64_t startTime)
+{
+    // qDebug() << pid << QByteArray(comm, commSize) << startTime;
 
-    m_tasks.emplace_back(Task::Exec, id, pid, comm, startTime, kthread);
-    m_pid2id[pid].push_back(id);
+    int preExecId = currentId(pid);
+    if (preExecId == -1)
+    {
+        m_unknownExecCount++;
+        return;
+    }
+    int id = appendTask(Task::Exec, pid, comm, commSize, startTime, kthread(preExecId));
 
-    m_tasks[static_cast<size_t>(id)].setPreExecId(preExecId);
-    m_tasks[static_cast<size_t>(preExecId)].setPostExecId(id);
-    m_tasks[static_cast<size_t>(preExecId)].setStopTime(startTime);
+    m_preExecId.ref(static_cast<size_t>(id)) = preExecId;
+    m_postExecId.ref(static_cast<size_t>(preExecId)) = id;
+    setStopTime(preExecId, startTime);
 }
 
 void TaskModel::taskExit(int pid, int64_t stopTime)
 {
     // qDebug() << pid << stopTime;
 
-    assert(m_pid2id[pid].size() != 0);
+    int id = currentId(pid);
+    if (id == -1)
+    {
+        m_unknownExitCount++;
+        return;
+    }
+    setStopTime(id, stopTime);
+}
+
+void TaskModel::addRunningTask(int pid, const char *comm, int commSize, int64_t windowStart)
+{
+    int id = appendTask(Task::Fork, pid, comm, commSize, windowStart, false);
 
-    int id = m_pid2id[pid].back();
-    m_tasks[static_cast<size_t>(id)].setStopTime(stopTime);
+    m_parentId.ref(static_cast<size_t>(id)) = 0;
+    m_flags.ref(static_cast<size_t>(id)) |= START_CLAMPED_FLAG;
+}
+
+void TaskModel::clampLivingTasks(int64_t windowEnd)
+{
+    detach();
+
+    // idle is never stopped
+    for (size_t i = 1; i < m_stopTime.size(); i++)
+    {
+        if (m_stopTime[i] == -1)
+        {
+            m_flags.ref(i) |= STOP_CLAMPED_FLAG;
+            setStopTime(static_cast<int>(i), windowEnd);
+        }
+    }
+}
+
+void TaskModel::finalize()
+{
+    if (m_unknownParentCount || m_unknownExecCount || m_unknownExitCount || m_unindexedPidCount)
+    {
+        qDebug() << "unknown tasks:" << m_unknownParentCount << "forks attached to idle,"
+                 << m_unknownExecCount << "execs and" << m_unknownExitCount << "exits ignored,"
+                 << m_unindexedPidCount << "pids out of range";
+        m_unknownParentCount = 0;
+        m_unknownExecCount = 0;
+        m_unknownExitCount = 0;
+        m_unindexedPidCount = 0;
+    }
+
+    const size_t taskCount = m_startTime.size();
+    const size_t indexed = m_childrenOffset.empty() ? 0 : m_childrenOffset.size() - 1;
+    if (indexed == taskCount)
+    {
+        return;
+    }
+
+    if (taskCount - indexed >= indexed)
+    {
+        buildChildren(m_childrenOffset, m_children);
+        m_lateChildren.clear();
+        return;
+    }
+
+    // the new tasks have no CSR children, a parent moves its list to
+    // m_lateChildren with its first late child
+    m_childrenOffset.resize(taskCount + 1, m_childrenOffset.back());
+    for (size_t i = indexed; i < taskCount; i++)
+    {
+        const int parent = m_parentId[i];
+        if (parent == -1)
+        {
+            continue;
+        }
+
+        auto it = m_lateChildren.find(parent);
+        if (it == m_lateChildren.end())
+        {
+            const size_t p = static_cast<size_t>(parent);
+            const int *base = m_children.data();
+            std::vector<int> list(base + m_childrenOffset[p], base + m_childrenOffset[p + 1]);
+            it = m_lateChildren.emplace(parent, std::move(list)).first;
+        }
+        it->second.push_back(static_cast<int>(i));
+    }
+}
+
+void TaskModel::buildChildren(Column<int> &offsets, Column<int> &children) const
+{
+    const size_t taskCount = m_startTime.size();
+
+    // A counting sort by parent. Children are visited in id order, so
+    // the children of a task stay sorted by creation like before.
+    offsets.assign(taskCount + 1, 0);
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        const int parent = m_parentId[i];
+        if (parent != -1)
+        {
+            offsets.ref(static_cast<size_t>(parent) + 1)++;
+        }
+    }
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        offsets.ref(i + 1) += offsets[i];
+    }
+
+    children.assign(static_cast<size_t>(offsets[taskCount]), 0);
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        const int parent = m_parentId[i];
+        if (parent != -1)
+        {
+            children.ref(static_cast<size_t>(next[static_cast<size_t>(parent)]++)) = static_cast<int>(i);
+        }
+    }
+}
+
+void TaskModel::setRecordStopped(bool enabled)
+{
+    m_recordStopped = enabled;
+    m_stopped.clear();
+}
+
+std::vector<int> TaskModel::takeStopped()
+{
+    std::vector<int> result;
+    result.swap(m_stopped);
+    return result;
 }
 
 Task TaskModel::rootTask() const
 {
-    assert(m_tasks.size() > 0);
-    return m_tasks[0];
+    assert(taskCount() > 0);
+    return Task(this, 0);
+}
+
+Task TaskModel::task(int id) const
+{
+    assert(taskCount() > id);
+    return Task(this, id);
+}
+
+int TaskModel::childrenCount(int id) const
+{
+    return children(id).size();
+}
+
+int TaskModel::childId(int id, int i) const
+{
+    const IdSpan ids = children(id);
+    assert(i >= 0 && i < ids.size());
+    return ids[i];
 }
 
-const Task &TaskModel::task(int id) const
+std::vector<int> TaskModel::pidHistory(int pid) const
 {
-    assert(m_tasks.size() > static_cast<size_t>(id));
-    return m_tasks[static_cast<size_t>(id)];
+    std::vector<int> result;
+    for (int id = currentId(pid); id != -1; id = m_prevPidId[static_cast<size_t>(id)])
+    {
+        result.push_back(id);
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+IdSpan TaskModel::children(int id) const
+{
+    const size_t i = index(id);
+    assert(i + 1 < m_childrenOffset.size());
+    if (!m_lateChildren.empty())
+    {
+        const auto it = m_lateChildren.find(id);
+        if (it != m_lateChildren.end())
+        {
+            return IdSpan(it->second.data(), it->second.data() + it->second.size());
+        }
+    }
+    const int *base = m_children.data();
+    return IdSpan(base + m_childrenOffset[i], base + m_childrenOffset[i + 1]);
 }
 
 QString TaskModel::dump() const
 {
     QString result;
-    const size_t size = m_tasks.size();
-    for (size_t i = 0; i < size; i++)
+    const int size = taskCount();
+    for (int i = 0; i < size; i++)
     {
-        result += m_tasks[i].dump() + "\n";
+        result += task(i).dump() + "\n";
     }
     return result;
 }
@@ -125,10 +739,141 @@ QString TaskModel::dumpTree() const
     return "";
 }
 
-void TaskModel::addIdleTask()
+void TaskModel::detach()
 {
-    int id = static_cast<int>(m_tasks.size());
+    if (!m_file)
+    {
+        return;
+    }
 
-    m_tasks.emplace_back(Task::Idle, id, 0, "idle", 0, true);
-    m_pid2id[id].push_back(id);
+    m_startTime.detach();
+    m_stopTime.detach();
+    m_pid.detach();
+    m_parentId.detach();
+    m_preExecId.detach();
+    m_postExecId.detach();
+    m_flags.detach();
+    m_commId.detach();
+    m_commHash.detach();
+    m_commBytes.detach();
+    m_commOffset.detach();
+    m_childrenOffset.detach();
+    m_children.detach();
+    m_pidToId.detach();
+    m_prevPidId.detach();
+
+    m_file.reset();
+}
+
+int TaskModel::appendTask(Task::Type type, int pid, const char *comm, int commSize, int64_t startTime, bool kthread)
+{
+    detach();
+
+    int id = taskCount();
+
+    const int commId = internComm(comm, commSize);
+
+    m_startTime.push_back(startTime);
+    m_stopTime.push_back(-1);
+    m_pid.push_back(pid);
+    m_parentId.push_back(-1);
+    m_preExecId.push_back(-1);
+    m_postExecId.push_back(-1);
+    m_flags.push_back(static_cast<uint8_t>(type | (kthread ? KTHREAD_FLAG : 0)));
+    m_commId.push_back(commId);
+
+    m_prevPidId.push_back(currentId(pid));
+    if (pid >= 0 && pid <= PID_MAX_LIMIT)
+    {
+        if (static_cast<size_t>(pid) >= m_pidToId.size())
+        {
+            m_pidToId.resize(static_cast<size_t>(pid) + 1, -1);
+        }
+        m_pidToId.ref(static_cast<size_t>(pid)) = id;
+    }
+    else
+    {
+        m_unindexedPidCount++;
+    }
+    return id;
+}
+
+int TaskModel::internComm(const char *comm, int commSize)
+{
+    const uint32_t hash = fnv1a(comm, commSize);
+
+    if ((m_commNames.size() + 1) * 2 > m_commTable.size())
+    {
+        growCommTable();
+    }
+
+    const size_t mask = m_commTable.size() - 1;
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        const int id = m_commTable[slot];
+        if (id == -1)
+        {
+            const int newId = static_cast<int>(m_commNames.size());
+            m_commTable[slot] = newId;
+
+            if (m_commOffset.empty())
+            {
+                m_commOffset.push_back(0);
+            }
+            m_commBytes.append(comm, comm + commSize);
+            m_commOffset.push_back(static_cast<int>(m_commBytes.size()));
+            m_commHash.push_back(hash);
+            m_commNames.push_back(QString::fromUtf8(comm, commSize));
+            return newId;
+        }
+
+        const size_t i = static_cast<size_t>(id);
+        if (m_commHash[i] == hash
+                && m_commOffset[i + 1] - m_commOffset[i] == commSize
+                && memcmp(m_commBytes.data() + m_commOffset[i], comm, static_cast<size_t>(commSize)) == 0)
+        {
+            return id;
+        }
+    }
+}
+
+void TaskModel::growCommTable()
+{
+    static const size_t MIN_TABLE_SIZE = 1024;
+
+    // keep it at most half full
+    const Column<uint32_t> &hashes = m_commHash;
+    size_t size = max(MIN_TABLE_SIZE, m_commTable.size() * 2);
+    while (size < (hashes.size() + 1) * 2)
+    {
+        size *= 2;
+    }
+    m_commTable.assign(size, -1);
+
+    const size_t mask = m_commTable.size() - 1;
+    for (size_t i = 0; i < hashes.size(); i++)
+    {
+        size_t slot = hashes[i] & mask;
+        while (m_commTable[slot] != -1)
+        {
+            slot = (slot + 1) & mask;
+        }
+        m_commTable[slot] = static_cast<int>(i);
+    }
+}
+
+void TaskModel::setStopTime(int id, int64_t stopTime)
+{
+    detach();
+    m_stopTime.ref(static_cast<size_t>(id)) = stopTime;
+    if (m_recordStopped)
+    {
+        m_stopped.push_back(id);
+    }
+}
+
+void TaskModel::addIdleTask()
+{
+    appendTask(Task::Idle, 0, "idle", 4, 0, true);
+    finalize();
 }
@@ -24,36 +24,209 @@
 
 #pragma once
 
+#include "column.h"
 #include "task.h"
 
+#include <QFile>
+
 #include <memory>
-#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <assert.h>
+#include <stdint.h>
 
+// The tasks are stored as columns indexed by id, so scanning one
+// attribute over the whole model touches only that attribute.
+//
+// Views share one model through a TaskModelPtr. It is not a snapshot:
+// its owner changes it in place on the GUI thread, by swap() with a
+// loaded model or by appending the records of a followed log or a
+// capture, and then tells the views what changed.
+//
+// A model can be saved as a snapshot file (.ttm) which holds the same
+// columns, little-endian. Loading one maps the file and uses the
+// columns in place, nothing is copied until the model is changed.
 class TaskModel
 {
 public:
     TaskModel();
     ~TaskModel();
 
+    TaskModel(const TaskModel &) = delete;
+    TaskModel &operator=(const TaskModel &) = delete;
+
     void clear();
 
+    // Exchange the tasks with other, e.g. a model built on another
+    // thread. Whether the stopped ids are recorded is not exchanged.
+    void swap(TaskModel &other);
+
+    // the file starts with the snapshot magic
+    static bool isSnapshot(const QString &path);
+    bool save(const QString &path) const;
+    // replaces the content of the model, which is left empty on error
+    bool load(const QString &path);
+
     void addForkTask(int pid, int ppid, const QString &comm, int64_t startTime, bool kthread);
     void addExecTask(int pid, const QString &comm, int64_t startTime);
+
+    // comm is a UTF-8 byte view which is only read during the call
+    void addForkTask(int pid, int ppid, const char *comm, int commSize, int64_t startTime, bool kthread);
+    void addExecTask(int pid, const char *comm, int commSize, int64_t startTime);
     void taskExit(int pid, int64_t stopTime);
 
+    // A task which was running when a time window of the log starts, so
+    // its fork was not read. It is attached to idle: its ancestors are
+    // not known without reading the log before the window, as a record
+    // only names the parent of a fork.
+    void addRunningTask(int pid, const char *comm, int commSize, int64_t windowStart);
+    // stop the tasks still living when a time window of the log ends
+    void clampLivingTasks(int64_t windowEnd);
+
+    // Index the children of the tasks added since the last call. The
+    // children accessors are only valid after it. A small batch costs
+    // only its own tasks, see m_lateChildren. The records of unknown
+    // tasks since the last call are logged once, as counts.
+    void finalize();
+
+    // Remember the ids whose stop time gets set, so that views can
+    // update only those after an incremental parse.
+    void setRecordStopped(bool enabled);
+    std::vector<int> takeStopped();
+
     Task rootTask() const;
-    const Task &task(int id) const;
-    int taskCount() const { return static_cast<int>(m_tasks.size()); }
+    Task task(int id) const;
+    int taskCount() const { return static_cast<int>(m_startTime.size()); }
+
+    Task::Type type(int id) const { return static_cast<Task::Type>(m_flags[index(id)] & TYPE_MASK); }
+    bool kthread(int id) const { return (m_flags[index(id)] & KTHREAD_FLAG) != 0; }
+    // the start time is the window start, the task started before it
+    bool startClamped(int id) const { return (m_flags[index(id)] & START_CLAMPED_FLAG) != 0; }
+    // the stop time is the window end, the task was still living
+    bool stopClamped(int id) const { return (m_flags[index(id)] & STOP_CLAMPED_FLAG) != 0; }
+    int pid(int id) const { return m_pid[index(id)]; }
+    int commId(int id) const { return m_commId[index(id)]; }
+    const QString &comm(int id) const { return commName(commId(id)); }
+    int64_t startTime(int id) const { return m_startTime[index(id)]; }
+    int64_t stopTime(int id) const { return m_stopTime[index(id)]; }
+    int parentId(int id) const { return m_parentId[index(id)]; }
+    int preExecId(int id) const { return m_preExecId[index(id)]; }
+    int postExecId(int id) const { return m_postExecId[index(id)]; }
+
+    int childrenCount(int id) const;
+    int childId(int id, int i) const;
+    IdSpan children(int id) const;
+
+    // all the tasks which had the pid so far, oldest first
+    std::vector<int> pidHistory(int pid) const;
+
+    // A log has millions of tasks but only a few thousand distinct comm
+    // values, so each one is stored once. Views can key what they derive
+    // from a comm by its id, which is in [0, commCount()).
+    int commCount() const { return static_cast<int>(m_commNames.size()); }
+    const QString &commName(int commId) const { return m_commNames[static_cast<size_t>(commId)]; }
+    // FNV-1a of the UTF-8 bytes, stable across runs
+    uint32_t commHash(int commId) const { return m_commHash[static_cast<size_t>(commId)]; }
+    // the UTF-8 bytes of a comm, without a terminating '\0'
+    const char *commBytes(int commId) const { return m_commBytes.data() + m_commOffset[static_cast<size_t>(commId)]; }
+    int commByteSize(int commId) const
+    {
+        return m_commOffset[static_cast<size_t>(commId) + 1] - m_commOffset[static_cast<size_t>(commId)];
+    }
+
+    // id of the last task with the pid, -1 if there is none
+    int currentId(int pid) const
+    {
+        return pid >= 0 && static_cast<size_t>(pid) < m_pidToId.size() ? m_pidToId[static_cast<size_t>(pid)] : -1;
+    }
 
     QString dump() const;
     QString dumpTree() const;
 
 private:
+    enum Flag : uint8_t
+    {
+        TYPE_MASK = 0x3,
+        KTHREAD_FLAG = 0x4,
+        START_CLAMPED_FLAG = 0x8,
+        STOP_CLAMPED_FLAG = 0x10
+    };
+
+    size_t index(int id) const
+    {
+        assert(id >= 0 && id < taskCount());
+        return static_cast<size_t>(id);
+    }
+
+    // copy the mapped columns before they are changed
+    void detach();
+
+    int appendTask(Task::Type type, int pid, const char *comm, int commSize, int64_t startTime, bool kthread);
+    int internComm(const char *comm, int commSize);
+    void growCommTable();
+
+    void setStopTime(int id, int64_t stopTime);
+
+    // the children of all the tasks in CSR form, by a counting sort
+    void buildChildren(Column<int> &offsets, Column<int> &children) const;
+    // whether the ids and the offsets of the mapped columns stay in
+    // them, a snapshot is not trusted
+    bool checkSnapshot() const;
+
     void addIdleTask();
 
 private:
-    // TaskData::m_id is always same with the index in m_tasks
-    std::vector<Task> m_tasks;
-    std::map<int, std::vector<int>> m_pid2id;
+    // the id of a task is its index in the columns
+    Column<int64_t> m_startTime;
+    Column<int64_t> m_stopTime;
+    Column<int> m_pid;
+    // they are NOT pids
+    Column<int> m_parentId;
+    Column<int> m_preExecId;
+    Column<int> m_postExecId;
+    Column<uint8_t> m_flags;
+    Column<int> m_commId;
+
+    // the interned comm values, by comm id
+    std::vector<QString> m_commNames;
+    Column<uint32_t> m_commHash;
+    // UTF-8 bytes of comm id i at m_commBytes[m_commOffset[i] .. m_commOffset[i + 1]]
+    Column<char> m_commBytes;
+    Column<int> m_commOffset;
+    // open addressing table of comm ids, -1 marks a free slot
+    std::vector<int> m_commTable;
+
+    // children in CSR form: the children of task i are
+    // m_children[m_childrenOffset[i] .. m_childrenOffset[i + 1]]
+    Column<int> m_childrenOffset;
+    Column<int> m_children;
+    // The children of the parents which got new ones since the last full
+    // build, the CSR ones included. A follow or capture update appends
+    // here instead of building the CSR arrays again. They are folded
+    // into the CSR arrays once a batch is as large as the model indexed
+    // so far, e.g. a whole log, so rebuilds stay amortized O(1) per task.
+    std::unordered_map<int, std::vector<int>> m_lateChildren;
+
+    // Indexed by pid, which is bounded by pid_max, so a flat table is
+    // small and every event resolves its pid with a single load. A pid
+    // above the largest pid_max is not indexed, and is never found.
+    Column<int> m_pidToId;
+    // the previous task with the same pid, -1 for the first one
+    Column<int> m_prevPidId;
+
+    // the snapshot the columns are mapped from
+    std::unique_ptr<QFile> m_file;
+
+    bool m_recordStopped;
+    std::vector<int> m_stopped;
+
+    // the records of unknown tasks since the last finalize(), a log
+    // cut from a long run has many
+    int m_unknownParentCount;
+    int m_unknownExecCount;
+    int m_unknownExitCount;
+    int m_unindexedPidCount;
 };
 
+typedef std::shared_ptr<TaskModel> TaskModelPtr;
@@ -1,9 +1,12 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++11
 
+# gzip rotated logs are read through zlib
+LIBS += -lz
+
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
 # depend on your compiler). Please consult the documentation of the
@@ -17,21 +20,45 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
     dmesgparser.cpp \
+    logfollower.cpp \
+    logindex.cpp \
+    logmerger.cpp \
     main.cpp \
     mainwindow.cpp \
+    modelloader.cpp \
+    streamsource.cpp \
     task.cpp \
     taskmodel.cpp \
+    tasktreemodel.cpp \
     textlayouter.cpp \
+    texttreeindex.cpp \
+    texttreeview.cpp \
+    timelinecanvas.cpp \
+    timelinedensity.cpp \
     timelineruler.cpp \
+    timelinetiles.cpp \
     timelinewidget.cpp
 
 HEADERS += \
+    column.h \
     dmesgparser.h \
+    logfollower.h \
+    logindex.h \
+    logmerger.h \
     mainwindow.h \
+    modelloader.h \
+    progress.h \
+    streamsource.h \
     task.h \
     taskmodel.h \
+    tasktreemodel.h \
     textlayouter.h \
+    texttreeindex.h \
+    texttreeview.h \
+    timelinecanvas.h \
+    timelinedensity.h \
     timelineruler.h \
+    timelinetiles.h \
     timelinewidget.h
 
 FORMS += \
@@ -0,0 +1,438 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "tasktreemodel.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+// rows created by one fetch, a view fetches again when it scrolls to the end
+static const int FETCH_BATCH = 256;
+
+TaskTreeModel::TaskTreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_lastTime(0)
+{
+    setModel(std::make_shared<TaskModel>());
+}
+
+void TaskTreeModel::setModel(const TaskModelPtr &model)
+{
+    beginResetModel();
+
+    m_model = model;
+    updateAggregates();
+
+    m_taskNodes.assign(static_cast<size_t>(m_model->taskCount()), -1);
+    m_nodes.clear();
+    m_nodes.push_back(Node(-1, -1, 0, 0));
+    m_nodes[0].childCount = childCount(0);
+    // idle, the only top level row
+    appendChildren(0, m_nodes[0].childCount);
+
+    endResetModel();
+}
+
+void TaskTreeModel::updateTasks(int firstNewId, const std::vector<int> &stoppedIds)
+{
+    const std::vector<int> changedIds = updateAggregates(firstNewId, stoppedIds);
+    m_taskNodes.resize(static_cast<size_t>(m_model->taskCount()), -1);
+
+    // the rows fetched so far whose chain holds a changed task, the new
+    // tasks are children of those chains
+    std::vector<int> changedNodes;
+    for (int id : changedIds)
+    {
+        int head = id;
+        while (m_model->preExecId(head) != -1)
+        {
+            head = m_model->preExecId(head);
+        }
+        const int node = m_taskNodes[static_cast<size_t>(head)];
+        if (node != -1)
+        {
+            changedNodes.push_back(node);
+        }
+    }
+    std::sort(changedNodes.begin(), changedNodes.end());
+    changedNodes.erase(std::unique(changedNodes.begin(), changedNodes.end()), changedNodes.end());
+
+    // the children of a chain are in creation order, the new ones are
+    // always at the end
+    std::vector<int> parentNodes(1, 0);
+    parentNodes.insert(parentNodes.end(), changedNodes.begin(), changedNodes.end());
+    for (int node : parentNodes)
+    {
+        const size_t i = static_cast<size_t>(node);
+        const int oldCount = m_nodes[i].childCount;
+        const int newCount = childCount(node);
+        if (newCount == oldCount)
+        {
+            continue;
+        }
+
+        m_nodes[i].childCount = newCount;
+        // a row which is not fully fetched gets the rest on demand
+        const int fetched = static_cast<int>(m_nodes[i].children.size());
+        if (fetched == oldCount)
+        {
+            beginInsertRows(indexOf(node), fetched, newCount - 1);
+            appendChildren(node, newCount - fetched);
+            endInsertRows();
+        }
+    }
+
+    // The exec chains, the sizes and the durations of those rows. The
+    // duration of a living row grows with the last time of the model, it
+    // is repainted along with the rows which changed.
+    for (int node : changedNodes)
+    {
+        const QModelIndex first = indexOf(node);
+        emit dataChanged(first, first.sibling(first.row(), ColumnCount - 1));
+    }
+}
+
+int TaskTreeModel::taskId(const QModelIndex &index) const
+{
+    return index.isValid() ? m_nodes[static_cast<size_t>(nodeOf(index))].id : -1;
+}
+
+QModelIndex TaskTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const Node &node = m_nodes[static_cast<size_t>(nodeOf(parent))];
+    if (row < 0 || row >= static_cast<int>(node.children.size()) || column < 0 || column >= ColumnCount)
+    {
+        return QModelIndex();
+    }
+    return createIndex(row, column, static_cast<quintptr>(node.children[static_cast<size_t>(row)]));
+}
+
+QModelIndex TaskTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+    {
+        return QModelIndex();
+    }
+    return indexOf(m_nodes[static_cast<size_t>(nodeOf(child))].parent);
+}
+
+int TaskTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+    {
+        return 0;
+    }
+    return static_cast<int>(m_nodes[static_cast<size_t>(nodeOf(parent))].children.size());
+}
+
+int TaskTreeModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent)
+    return ColumnCount;
+}
+
+bool TaskTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+    {
+        return false;
+    }
+    return childCount(nodeOf(parent)) > 0;
+}
+
+bool TaskTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+    {
+        return false;
+    }
+    const int node = nodeOf(parent);
+    return static_cast<int>(m_nodes[static_cast<size_t>(node)].children.size()) < childCount(node);
+}
+
+void TaskTreeModel::fetchMore(const QModelIndex &parent)
+{
+    const int node = nodeOf(parent);
+    const int fetched = static_cast<int>(m_nodes[static_cast<size_t>(node)].children.size());
+    const int count = std::min(childCount(node) - fetched, FETCH_BATCH);
+    if (count <= 0)
+    {
+        return;
+    }
+
+    beginInsertRows(parent, fetched, fetched + count - 1);
+    appendChildren(node, count);
+    endInsertRows();
+}
+
+QVariant TaskTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+    {
+        return QVariant();
+    }
+
+    const int id = taskId(index);
+    const size_t i = static_cast<size_t>(id);
+    if (role == Qt::DisplayRole)
+    {
+        switch (index.column())
+        {
+        case TaskColumn:
+        {
+            QString text = m_model->task(id).description();
+            for (int curId = m_model->postExecId(id); curId != -1; curId = m_model->postExecId(curId))
+            {
+                text += QLatin1String(" -> ");
+                text += m_model->task(curId).description();
+            }
+            return text;
+        }
+        case SizeColumn:
+            return m_subtreeSize[i];
+        case DurationColumn:
+        {
+            const int64_t stop = m_subtreeLiving[i] > 0 ? m_lastTime : m_subtreeStop[i];
+            return QString::number((stop - m_model->startTime(id)) / 1000000.0, 'f', 6) + " s";
+        }
+        default:
+            break;
+        }
+    }
+    else if (role == Qt::TextAlignmentRole && index.column() != TaskColumn)
+    {
+        return static_cast<int>(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    return QVariant();
+}
+
+QVariant TaskTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+    {
+        return QVariant();
+    }
+
+    switch (section)
+    {
+    case TaskColumn:
+        return tr("Task");
+    case SizeColumn:
+        return tr("Subtree Tasks");
+    case DurationColumn:
+        return tr("Duration");
+    default:
+        return QVariant();
+    }
+}
+
+int TaskTreeModel::nodeOf(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<int>(index.internalId()) : 0;
+}
+
+QModelIndex TaskTreeModel::indexOf(int node) const
+{
+    if (node <= 0)
+    {
+        return QModelIndex();
+    }
+    return createIndex(m_nodes[static_cast<size_t>(node)].row, 0, static_cast<quintptr>(node));
+}
+
+int TaskTreeModel::childCount(int node) const
+{
+    const int id = m_nodes.empty() ? -1 : m_nodes[static_cast<size_t>(node)].id;
+    if (id == -1)
+    {
+        return m_model->taskCount() > 0 ? 1 : 0;
+    }
+
+    int count = 0;
+    for (int curId = id; curId != -1; curId = m_model->postExecId(curId))
+    {
+        count += m_model->childrenCount(curId);
+    }
+    return count;
+}
+
+void TaskTreeModel::appendChildren(int node, int count)
+{
+    // m_nodes grows, so node is only referred to by its index
+    int row = static_cast<int>(m_nodes[static_cast<size_t>(node)].children.size());
+    const int end = row + count;
+
+    std::vector<int> ids;
+    ids.reserve(static_cast<size_t>(count));
+    const int id = m_nodes[static_cast<size_t>(node)].id;
+    if (id == -1)
+    {
+        ids.push_back(0);
+    }
+    else
+    {
+        int skip = row;
+        for (int curId = id; curId != -1 && static_cast<int>(ids.size()) < count; curId = m_model->postExecId(curId))
+        {
+            const int n = m_model->childrenCount(curId);
+            for (int i = skip; i < n && static_cast<int>(ids.size()) < count; i++)
+            {
+                ids.push_back(m_model->childId(curId, i));
+            }
+            skip = std::max(skip - n, 0);
+        }
+    }
+
+    for (size_t i = 0; i < ids.size() && row < end; i++, row++)
+    {
+        const int child = static_cast<int>(m_nodes.size());
+        m_nodes.push_back(Node(ids[i], node, row, 0));
+        m_nodes.back().childCount = childCount(child);
+        m_nodes[static_cast<size_t>(node)].children.push_back(child);
+        m_taskNodes[static_cast<size_t>(ids[i])] = child;
+    }
+}
+
+int TaskTreeModel::ownerId(int id) const
+{
+    const int parentId = m_model->parentId(id);
+    return parentId != -1 ? parentId : m_model->preExecId(id);
+}
+
+void TaskTreeModel::updateAggregates()
+{
+    const int taskCount = m_model->taskCount();
+    const size_t size = static_cast<size_t>(taskCount);
+
+    m_lastTime = 0;
+    m_subtreeSize.assign(size, 1);
+    m_subtreeLiving.resize(size);
+    m_subtreeStop.resize(size);
+    m_living.resize(size);
+    for (int id = 0; id < taskCount; id++)
+    {
+        const size_t i = static_cast<size_t>(id);
+        const int64_t stop = m_model->stopTime(id);
+        m_lastTime = std::max(m_lastTime, std::max(m_model->startTime(id), stop));
+        m_living[i] = stop == -1;
+        m_subtreeLiving[i] = m_living[i];
+        m_subtreeStop[i] = stop;
+    }
+
+    // A task is always added after its parent and its pre exec task, so
+    // a reverse scan sees a subtree complete before its owner.
+    for (int id = taskCount - 1; id > 0; id--)
+    {
+        const int owner = ownerId(id);
+        if (owner == -1)
+        {
+            continue;
+        }
+        const size_t i = static_cast<size_t>(id);
+        const size_t o = static_cast<size_t>(owner);
+        m_subtreeSize[o] += m_subtreeSize[i];
+        m_subtreeLiving[o] += m_subtreeLiving[i];
+        m_subtreeStop[o] = std::max(m_subtreeStop[o], m_subtreeStop[i]);
+    }
+}
+
+std::vector<int> TaskTreeModel::updateAggregates(int firstNewId, const std::vector<int> &stoppedIds)
+{
+    assert(firstNewId == static_cast<int>(m_subtreeSize.size()));
+
+    struct Delta
+    {
+        Delta() : size(0), living(0), stop(-1) {}
+
+        int size;
+        int living;
+        int64_t stop;
+    };
+    // by task id, what is added to its aggregates
+    std::map<int, Delta> deltas;
+
+    const int taskCount = m_model->taskCount();
+    const size_t size = static_cast<size_t>(taskCount);
+    m_subtreeSize.resize(size, 0);
+    m_subtreeLiving.resize(size, 0);
+    m_subtreeStop.resize(size, -1);
+    m_living.resize(size, 0);
+    for (int id = firstNewId; id < taskCount; id++)
+    {
+        const int64_t stop = m_model->stopTime(id);
+        m_lastTime = std::max(m_lastTime, std::max(m_model->startTime(id), stop));
+        m_living[static_cast<size_t>(id)] = stop == -1;
+
+        Delta &delta = deltas[id];
+        delta.size++;
+        delta.living += stop == -1;
+        delta.stop = std::max(delta.stop, stop);
+    }
+    for (int id : stoppedIds)
+    {
+        // a new task is counted as it is now
+        const size_t i = static_cast<size_t>(id);
+        if (id >= firstNewId || !m_living[i])
+        {
+            continue;
+        }
+        const int64_t stop = m_model->stopTime(id);
+        m_lastTime = std::max(m_lastTime, stop);
+        m_living[i] = false;
+
+        Delta &delta = deltas[id];
+        delta.living--;
+        delta.stop = std::max(delta.stop, stop);
+    }
+
+    // From the largest id down, like the reverse scan: the delta of a
+    // task is complete when it is passed on to its owner, so each
+    // ancestor is updated once.
+    std::vector<int> changedIds;
+    while (!deltas.empty())
+    {
+        const auto last = std::prev(deltas.end());
+        const int id = last->first;
+        const Delta delta = last->second;
+        deltas.erase(last);
+
+        const size_t i = static_cast<size_t>(id);
+        m_subtreeSize[i] += delta.size;
+        m_subtreeLiving[i] += delta.living;
+        m_subtreeStop[i] = std::max(m_subtreeStop[i], delta.stop);
+        changedIds.push_back(id);
+
+        const int owner = ownerId(id);
+        if (owner != -1)
+        {
+            Delta &ownerDelta = deltas[owner];
+            ownerDelta.size += delta.size;
+            ownerDelta.living += delta.living;
+            ownerDelta.stop = std::max(ownerDelta.stop, delta.stop);
+        }
+    }
+    return changedIds;
+}
@@ -0,0 +1,128 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include "taskmodel.h"
+
+#include <QAbstractItemModel>
+
+#include <vector>
+
+#include <stdint.h>
+
+// Presents a TaskModel as a tree for a QTreeView. A row is a fork with
+// its exec chain, like a line of the text tree, and its children are
+// the forks of the whole chain, oldest first. The rows are created when
+// the view fetches them, so a collapsed subtree costs nothing but its
+// aggregates, which are computed for all tasks in one pass and then
+// updated along the ancestors of the tasks which change.
+class TaskTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    enum Column
+    {
+        TaskColumn,
+        // the tasks in the subtree of the row, its exec chain included
+        SizeColumn,
+        // from the start of the row until its whole subtree has stopped
+        DurationColumn,
+        ColumnCount
+    };
+
+    explicit TaskTreeModel(QObject *parent = nullptr);
+
+    void setModel(const TaskModelPtr &model);
+    // The tasks from firstNewId on have been appended to the model in
+    // place, and the tasks of stoppedIds have stopped, see
+    // TaskModel::takeStopped(): update the aggregates of their ancestors,
+    // append the new children of the rows fetched so far and refresh the
+    // rows of those ancestors.
+    void updateTasks(int firstNewId, const std::vector<int> &stoppedIds);
+
+    // the first task of the exec chain of the row, -1 for an invalid index
+    int taskId(const QModelIndex &index) const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    // a row created by a fetch, m_nodes[0] is the invisible root
+    struct Node
+    {
+        Node(int _id, int _parent, int _row, int _childCount)
+            : id(_id), parent(_parent), row(_row), childCount(_childCount) {}
+
+        int id;
+        int parent;
+        int row;
+        // the children of the chain when the node was last updated
+        int childCount;
+        std::vector<int> children;
+    };
+
+    int nodeOf(const QModelIndex &index) const;
+    QModelIndex indexOf(int node) const;
+
+    // the forks of the exec chain of the node
+    int childCount(int node) const;
+    // create the next count child nodes, without notifying the views
+    void appendChildren(int node, int count);
+
+    // the task whose subtree holds the one of id, -1 for idle
+    int ownerId(int id) const;
+    void updateAggregates();
+    // add the tasks from firstNewId on and stop those of stoppedIds,
+    // returns the tasks whose aggregates changed
+    std::vector<int> updateAggregates(int firstNewId, const std::vector<int> &stoppedIds);
+
+private:
+    TaskModelPtr m_model;
+    std::vector<Node> m_nodes;
+    // by task id, the node of the row started by the task, -1 if the row
+    // has not been fetched
+    std::vector<int> m_taskNodes;
+
+    // By task id, the subtree of a task includes its post exec tasks.
+    // Each one only grows or shrinks by what is added or stopped, so an
+    // update only walks up from the tasks which changed.
+    std::vector<int> m_subtreeSize;
+    // the living tasks in the subtree, which count as stopping at the
+    // last time of the model
+    std::vector<int> m_subtreeLiving;
+    // the latest stop time in the subtree, -1 if none has stopped
+    std::vector<int64_t> m_subtreeStop;
+    // by task id, whether the task is counted in m_subtreeLiving
+    std::vector<char> m_living;
+    int64_t m_lastTime;
+};
@@ -22,103 +22,247 @@
  * SOFTWARE.
  ********************************************************************************/
 
+
 #include "textlayouter.h"
 
 #include <QDebug>
+#include <QSaveFile>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <string.h>
 
 using namespace std;
 
-struct TextLayoutData
-{
-    explicit TextLayoutData(int _id, int _x = 0) : id(_id), x(_x), nextLayoutChild(0) {}
+namespace {
 
-    int id;
-    int x;
-    int nextLayoutChild;
+// bytes collected before a write to the device
+const int DEVICE_BLOCK_SIZE = 256 * 1024;
+// smaller models are laid out faster than the threads start
+const int PARALLEL_MIN_TASKS = 64 * 1024;
+// lines rendered by a worker at once
+const int CHUNK_LINES = 8192;
+
+struct LayoutChunk
+{
+    // at the first line of the chunk
+    TextTreeCursor cursor;
+    string text;
 };
 
-TextLayouter::TextLayouter(const TaskModel &model)
-    : m_model(model)
+void renderChunk(LayoutChunk &chunk)
 {
+    chunk.text.clear();
+    for (int i = 0; i < CHUNK_LINES && !chunk.cursor.atEnd(); i++)
+    {
+        chunk.cursor.nextLine(&chunk.text);
+        chunk.text += '\n';
+    }
+}
 
+// hand the lines of the chunk to the sink one by one
+bool writeChunk(const LayoutChunk &chunk, TextLayoutSink &sink)
+{
+    const char *p = chunk.text.data();
+    const char *end = p + chunk.text.size();
+    while (p < end)
+    {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!sink.write(p, lineEnd - p + 1))
+        {
+            return false;
+        }
+        p = lineEnd + 1;
+    }
+    return true;
 }
 
-static void appendSpace(QString &s, int x)
+// the chunks are reused, so are the capacities of their texts
+size_t takeChunks(const vector<TextTreeCursor> &starts, size_t next, QVector<LayoutChunk> &chunks, int count)
 {
-    int delta = x - s.size();
-    if (delta > 0)
+    const size_t remaining = starts.size() - next;
+    chunks.resize(static_cast<int>(qMin(static_cast<size_t>(count), remaining)));
+    for (LayoutChunk &chunk : chunks)
     {
-        s += QString(delta, ' ');
+        chunk.cursor = starts[next++];
     }
+    return next;
+}
+
+}
+
+DeviceLayoutSink::DeviceLayoutSink(QIODevice *device)
+    : m_device(device)
+{
+    m_buffer.reserve(DEVICE_BLOCK_SIZE);
+}
+
+DeviceLayoutSink::~DeviceLayoutSink()
+{
+    flush();
+}
+
+bool DeviceLayoutSink::write(const char *data, qint64 size)
+{
+    m_buffer.append(data, static_cast<int>(size));
+    return m_buffer.size() < DEVICE_BLOCK_SIZE || flush();
+}
+
+bool DeviceLayoutSink::flush()
+{
+    if (m_buffer.isEmpty())
+    {
+        return true;
+    }
+
+    const bool ok = m_device->write(m_buffer) == m_buffer.size();
+    if (!ok)
+    {
+        qDebug() << "cannot write the text tree:" << m_device->errorString();
+    }
+    // resize keeps the reserved capacity, clear would not
+    m_buffer.resize(0);
+    return ok;
+}
+
+TextLayouter::TextLayouter(const TaskModel &model)
+    : m_model(model)
+    , m_threadCount(QThread::idealThreadCount())
+{
+
+}
+
+const TextTreeStyle &TextLayouter::style() const
+{
+    return m_style;
+}
+
+void TextLayouter::setStyle(const TextTreeStyle &style)
+{
+    m_style = style;
 }
 
-QString TextLayouter::layout()
+int TextLayouter::threadCount() const
 {
-    vector<TextLayoutData> layouting;
+    return m_threadCount;
+}
 
-    QString result;
-    const int taskCount = m_model.taskCount();
-    assert(taskCount >= 0);
+void TextLayouter::setThreadCount(int threadCount)
+{
+    m_threadCount = qMax(1, threadCount);
+}
 
+bool TextLayouter::layoutToFile(const QString &path)
+{
+    if (path == "-")
     {
-        TextLayoutData d(0);
-        result += m_model.task(d.id).description() + "\n";
-        if (m_model.task(d.id).childrenId().size() != 0)
+        QFile file;
+        if (!file.open(stdout, QIODevice::WriteOnly))
         {
-            layouting.push_back(d);
+            qDebug() << file.errorString();
+            return false;
         }
-        else
+        DeviceLayoutSink sink(&file);
+        return layout(sink) && sink.flush();
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << file.errorString();
+        return false;
+    }
+    DeviceLayoutSink sink(&file);
+    if (!layout(sink) || !sink.flush())
+    {
+        return false;
+    }
+    return file.commit();
+}
+
+bool TextLayouter::layout(TextLayoutSink &sink)
+{
+    assert(m_model.taskCount() >= 0);
+
+    if (m_threadCount > 1 && m_model.taskCount() >= PARALLEL_MIN_TASKS)
+    {
+        return layoutParallel(sink);
+    }
+    return layoutSequential(sink);
+}
+
+bool TextLayouter::layoutSequential(TextLayoutSink &sink)
+{
+    TextTreeCursor cursor(&m_model, m_style);
+    cursor.seek(0);
+
+    // the line buffer is reused
+    string line;
+    while (!cursor.atEnd())
+    {
+        cursor.nextLine(&line);
+        line += '\n';
+        if (!sink.write(line.data(), static_cast<qint64>(line.size())))
         {
-            qDebug() << "only a idle task";
+            return false;
         }
+        line.clear();
     }
 
-    static const QString FORK_PREFIX = " \\_ ";
-    static const QString EXEC_PREFIX = " -> ";
-    static const QString PROCESSING_PREFIX = " |  ";
+    return true;
+}
 
-    size_t layoutingSize = 0;
-    while ((layoutingSize = layouting.size()) != 0)
+bool TextLayouter::layoutParallel(TextLayoutSink &sink)
+{
+    // The first pass only measures the lines, and keeps a copy of the
+    // layout stack at the start of every chunk of lines.
+    vector<TextTreeCursor> starts;
     {
-        QString line;
-        for (size_t i = 0; i < layoutingSize - 1; i++)
+        TextTreeCursor cursor(&m_model, m_style);
+        cursor.seek(0);
+        int line = 0;
+        while (!cursor.atEnd())
         {
-            TextLayoutData &d = layouting[i];
-            appendSpace(line, d.x);
-            line += PROCESSING_PREFIX;
+            if (line % CHUNK_LINES == 0)
+            {
+                starts.push_back(cursor);
+            }
+            cursor.nextLine(nullptr);
+            line++;
         }
+    }
 
-        TextLayoutData &lastD = layouting.back();
-        appendSpace(line, lastD.x);
-        line += FORK_PREFIX;
+    // Workers render the next chunks while this thread writes the
+    // current ones, in order, to the sink.
+    QVector<LayoutChunk> current;
+    QVector<LayoutChunk> next;
 
-        const Task &lastT = m_model.task(lastD.id);
-        int curId = lastT.childrenId(lastD.nextLayoutChild);
+    size_t nextStart = takeChunks(starts, 0, current, m_threadCount);
+    QFuture<void> future = QtConcurrent::map(current, renderChunk);
+
+    while (!current.isEmpty())
+    {
+        future.waitForFinished();
 
-        lastD.nextLayoutChild++;
-        if (lastD.nextLayoutChild >= lastT.childrenCount())
+        nextStart = takeChunks(starts, nextStart, next, m_threadCount);
+        QFuture<void> nextFuture;
+        if (!next.isEmpty())
         {
-            layouting.pop_back();
+            nextFuture = QtConcurrent::map(next, renderChunk);
         }
 
-        while (curId != -1)
+        for (const LayoutChunk &chunk : current)
         {
-            const Task &t = m_model.task(curId);
-            TextLayoutData d(curId, line.size());
-            if (t.childrenCount() > 0)
+            if (!writeChunk(chunk, sink))
             {
-                layouting.push_back(d);
-            }
-            line += t.description();
-
-            curId = t.postExecId();
-            if (curId != -1)
-            {
-                line += EXEC_PREFIX;
+                nextFuture.waitForFinished();
+                return false;
             }
         }
-        result += line + "\n";
+
+        current.swap(next);
+        future = nextFuture;
     }
 
-    return result;
+    return true;
 }
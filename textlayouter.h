@@ -22,17 +22,73 @@
  * SOFTWARE.
  ********************************************************************************/
 
+
 #pragma once
 
 #include "taskmodel.h"
+#include "texttreeindex.h"
+
+#include <QByteArray>
+#include <QIODevice>
+
+// Receives the text tree as UTF-8, a line at a time
+class TextLayoutSink
+{
+public:
+    virtual ~TextLayoutSink() {}
+
+    // a whole line with its '\n', false stops the layout
+    virtual bool write(const char *data, qint64 size) = 0;
+};
+
+// Writes to a file, stdout, a socket... in large blocks
+class DeviceLayoutSink : public TextLayoutSink
+{
+public:
+    explicit DeviceLayoutSink(QIODevice *device);
+    ~DeviceLayoutSink() override;
 
+    bool write(const char *data, qint64 size) override;
+    bool flush();
+
+private:
+    QIODevice *m_device;
+    QByteArray m_buffer;
+};
+
+// Lays out the tasks as a text tree, the way ps --forest does. The
+// lines are handed to a sink as they are built, so the extra memory
+// does not depend on the size of the model.
+//
+// A large model is laid out in two passes. The first one walks the tree
+// without building any text and keeps the layout stack, i.e. the
+// columns of the ancestors and which of them still draw a "|", at every
+// range of lines. The ranges are then rendered by worker threads and
+// written in order, the output is the same as a single thread's.
 class TextLayouter
 {
 public:
     explicit TextLayouter(const TaskModel &model);
-    QString layout();
+
+    // false if the sink stopped it
+    bool layout(TextLayoutSink &sink);
+    // to a file, which is replaced only once it is complete, or to stdout for "-"
+    bool layoutToFile(const QString &path);
+
+    // the aligned style by default, the one of ps --forest
+    const TextTreeStyle &style() const;
+    void setStyle(const TextTreeStyle &style);
+
+    // number of threads rendering lines, the sink is always called by the caller thread
+    int threadCount() const;
+    void setThreadCount(int threadCount);
+
+private:
+    bool layoutSequential(TextLayoutSink &sink);
+    bool layoutParallel(TextLayoutSink &sink);
 
 private:
     const TaskModel &m_model;
+    TextTreeStyle m_style;
+    int m_threadCount;
 };
-
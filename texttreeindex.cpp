@@ -0,0 +1,583 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "texttreeindex.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include <stdio.h>
+
+using namespace std;
+
+static const char FORK_PREFIX[] = " \\_ ";
+static const char EXEC_PREFIX[] = " -> ";
+static const char PROCESSING_PREFIX[] = " |  ";
+static const int PREFIX_SIZE = 4;
+// the compact style puts an exec on its own line, under its pre exec task
+static const char CONTINUATION_PREFIX[] = "-> ";
+static const int CONTINUATION_PREFIX_SIZE = 3;
+// tasks indexed between two progress reports
+static const int PROGRESS_TASKS = 64 * 1024;
+
+// the width of the description of Task, in UTF-16 code units
+static int descriptionWidth(const TaskModel &model, int id)
+{
+    // "[%1] " of the pid
+    int pid = model.pid(id);
+    int width = pid < 0 ? 4 : 3;
+    do
+    {
+        width++;
+        pid /= 10;
+    } while (pid != 0);
+
+    width += model.comm(id).size();
+    if (model.startClamped(id))
+    {
+        width += 16;
+    }
+    if (model.stopTime(id) == -1 || model.stopClamped(id))
+    {
+        width += 8;
+    }
+    return width;
+}
+
+// the first task of the exec chain holding id
+static int chainHead(const TaskModel &model, int id)
+{
+    int preExecId = -1;
+    while ((preExecId = model.preExecId(id)) != -1)
+    {
+        id = preExecId;
+    }
+    return id;
+}
+
+// Builds a line in UTF-8, or only measures it without an output. The
+// columns are counted in UTF-16 code units like QString, so the layout
+// does not change with the encoding.
+class TextLineWriter
+{
+public:
+    TextLineWriter(const TaskModel &model, string *out) : m_model(model), m_out(out), m_column(0) {}
+
+    int column() const { return m_column; }
+
+    void appendAscii(const char *text, int size)
+    {
+        if (m_out)
+        {
+            m_out->append(text, static_cast<size_t>(size));
+        }
+        m_column += size;
+    }
+
+    // pad with spaces up to column
+    void appendSpace(int column)
+    {
+        const int delta = column - m_column;
+        if (delta > 0)
+        {
+            if (m_out)
+            {
+                m_out->append(static_cast<size_t>(delta), ' ');
+            }
+            m_column = column;
+        }
+    }
+
+    void appendDescription(int id)
+    {
+        if (!m_out)
+        {
+            m_column += descriptionWidth(m_model, id);
+            return;
+        }
+
+        char pid[16];
+        const int pidSize = snprintf(pid, sizeof(pid), "[%d] ", m_model.pid(id));
+        appendAscii(pid, pidSize);
+
+        const int commId = m_model.commId(id);
+        m_out->append(m_model.commBytes(commId), static_cast<size_t>(m_model.commByteSize(commId)));
+        m_column += m_model.commName(commId).size();
+
+        if (m_model.startClamped(id))
+        {
+            appendAscii("(started before)", 16);
+        }
+        if (m_model.stopTime(id) == -1 || m_model.stopClamped(id))
+        {
+            appendAscii("(living)", 8);
+        }
+    }
+
+private:
+    const TaskModel &m_model;
+    string *m_out;
+    int m_column;
+};
+
+namespace {
+
+// the index of child in the children of id, which are sorted
+int childIndex(const TaskModel &model, int id, int child)
+{
+    const IdSpan children = model.children(id);
+    return static_cast<int>(lower_bound(children.begin(), children.end(), child) - children.begin());
+}
+
+}
+
+TextTreeCursor::TextTreeCursor()
+    : m_model(nullptr)
+    , m_atRoot(false)
+    , m_lineWidth(0)
+    , m_pendingExec(-1)
+    , m_chainX(0)
+{
+
+}
+
+TextTreeCursor::TextTreeCursor(const TaskModel *model, const TextTreeStyle &style)
+    : m_model(model)
+    , m_style(style)
+    , m_atRoot(false)
+    , m_lineWidth(0)
+    , m_pendingExec(-1)
+    , m_chainX(0)
+{
+
+}
+
+void TextTreeCursor::seek(int head)
+{
+    m_stack.clear();
+    m_pendingExec = -1;
+    m_atRoot = head == 0;
+    if (m_atRoot)
+    {
+        return;
+    }
+    assert(!m_style.compact);
+
+    // From the parent of head up to idle: each task whose children
+    // lead to the line, with that child.
+    vector<pair<int, int>> path;
+    int child = head;
+    while (child != 0)
+    {
+        const int parent = m_model->parentId(child);
+        path.push_back(make_pair(parent, child));
+        child = chainHead(*m_model, parent);
+    }
+
+    // Down from idle, what the layout stack holds before the line. In
+    // the chain of a line, the tasks with children before the one on the
+    // path are still waiting for their turn, those after it have been
+    // popped already. The one on the path stays while it has children
+    // after the path.
+    int column = 0;
+    for (size_t i = path.size(); i-- > 0;)
+    {
+        const int task = path[i].first;
+        int curId = chainHead(*m_model, task);
+        while (curId != task)
+        {
+            if (m_model->childrenCount(curId) > 0)
+            {
+                m_stack.push_back(Entry(curId, column, 0));
+            }
+            column += descriptionWidth(*m_model, curId) + PREFIX_SIZE;
+            curId = m_model->postExecId(curId);
+        }
+
+        const int index = childIndex(*m_model, task, path[i].second);
+        if (i == 0)
+        {
+            m_stack.push_back(Entry(task, column, index));
+        }
+        else if (index + 1 < m_model->childrenCount(task))
+        {
+            m_stack.push_back(Entry(task, column, index + 1));
+        }
+        column += PREFIX_SIZE;
+    }
+}
+
+bool TextTreeCursor::atEnd() const
+{
+    return !m_atRoot && m_stack.empty() && m_pendingExec == -1;
+}
+
+int TextTreeCursor::head() const
+{
+    if (m_atRoot)
+    {
+        return 0;
+    }
+    if (m_pendingExec != -1)
+    {
+        return m_pendingExec;
+    }
+    if (m_stack.empty())
+    {
+        return -1;
+    }
+    const Entry &lastD = m_stack.back();
+    return m_model->childId(lastD.id, lastD.nextChild);
+}
+
+int TextTreeCursor::nextLine(string *out)
+{
+    TextLineWriter writer(*m_model, out);
+    const int taskCount = m_style.compact ? nextCompactLine(writer) : nextAlignedLine(writer);
+    m_lineWidth = writer.column();
+    return taskCount;
+}
+
+int TextTreeCursor::nextAlignedLine(TextLineWriter &writer)
+{
+    int curId = 0;
+    if (m_atRoot)
+    {
+        m_atRoot = false;
+    }
+    else
+    {
+        const size_t stackSize = m_stack.size();
+        for (size_t i = 0; i + 1 < stackSize; i++)
+        {
+            writer.appendSpace(m_stack[i].x);
+            writer.appendAscii(PROCESSING_PREFIX, PREFIX_SIZE);
+        }
+
+        Entry &lastD = m_stack.back();
+        writer.appendSpace(lastD.x);
+        writer.appendAscii(FORK_PREFIX, PREFIX_SIZE);
+
+        const int lastId = lastD.id;
+        curId = m_model->childId(lastId, lastD.nextChild);
+
+        lastD.nextChild++;
+        if (lastD.nextChild >= m_model->childrenCount(lastId))
+        {
+            m_stack.pop_back();
+        }
+    }
+
+    int taskCount = 0;
+    while (curId != -1)
+    {
+        if (m_model->childrenCount(curId) > 0)
+        {
+            m_stack.push_back(Entry(curId, writer.column(), 0));
+        }
+        writer.appendDescription(curId);
+        taskCount++;
+
+        curId = m_model->postExecId(curId);
+        if (curId != -1)
+        {
+            writer.appendAscii(EXEC_PREFIX, PREFIX_SIZE);
+        }
+    }
+    return taskCount;
+}
+
+int TextTreeCursor::nextCompactLine(TextLineWriter &writer)
+{
+    // One entry stands for the whole exec chain of a line: it takes the
+    // children of the last task of the chain first, then those of the
+    // tasks before it, in the order of the aligned style.
+    int curId = 0;
+    if (m_pendingExec != -1)
+    {
+        curId = m_pendingExec;
+        const int shift = appendCompactPrefix(writer, m_stack.size(), m_chainX);
+        writer.appendSpace(m_chainX + shift);
+        writer.appendAscii(CONTINUATION_PREFIX, CONTINUATION_PREFIX_SIZE);
+    }
+    else if (m_atRoot)
+    {
+        m_atRoot = false;
+        m_chainX = 0;
+    }
+    else
+    {
+        Entry &lastD = m_stack.back();
+        m_chainX = lastD.x + PREFIX_SIZE;
+        const int shift = appendCompactPrefix(writer, m_stack.size() - 1, m_chainX);
+        writer.appendSpace(lastD.x + shift);
+        writer.appendAscii(FORK_PREFIX, PREFIX_SIZE);
+
+        curId = m_model->childId(lastD.id, lastD.nextChild);
+
+        lastD.nextChild++;
+        while (lastD.nextChild >= m_model->childrenCount(lastD.id))
+        {
+            lastD.id = m_model->preExecId(lastD.id);
+            lastD.nextChild = 0;
+            if (lastD.id == -1)
+            {
+                m_stack.pop_back();
+                break;
+            }
+        }
+    }
+
+    writer.appendDescription(curId);
+
+    m_pendingExec = m_model->postExecId(curId);
+    if (m_pendingExec != -1)
+    {
+        return 1;
+    }
+
+    // the chain is complete, its children come next
+    for (int id = curId; id != -1; id = m_model->preExecId(id))
+    {
+        if (m_model->childrenCount(id) > 0)
+        {
+            m_stack.push_back(Entry(id, m_chainX, 0));
+            break;
+        }
+    }
+    return 1;
+}
+
+int TextTreeCursor::appendCompactPrefix(TextLineWriter &writer, size_t count, int column)
+{
+    int hidden = 0;
+    int shift = 0;
+    if (m_style.maxLevels > 0)
+    {
+        hidden = max(column / PREFIX_SIZE - m_style.maxLevels, 0);
+    }
+    if (hidden > 0)
+    {
+        char marker[16];
+        const int markerSize = snprintf(marker, sizeof(marker), "...%d ", hidden);
+        writer.appendAscii(marker, markerSize);
+        shift = markerSize - hidden * PREFIX_SIZE;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const int x = m_stack[i].x;
+        if (x >= hidden * PREFIX_SIZE)
+        {
+            writer.appendSpace(x + shift);
+            writer.appendAscii(PROCESSING_PREFIX, PREFIX_SIZE);
+        }
+    }
+    return shift;
+}
+
+TextTreeIndex::TextTreeIndex()
+    : m_model(nullptr)
+    , m_maxColumn(0)
+{
+
+}
+
+void TextTreeIndex::clear()
+{
+    m_model = nullptr;
+    m_lineHeads.clear();
+    m_lineHeads.shrink_to_fit();
+    m_maxColumn = 0;
+}
+
+bool TextTreeIndex::build(const TaskModel *model, const ProgressCallback &progress)
+{
+    clear();
+    m_model = model;
+    if (!m_model || m_model->taskCount() == 0)
+    {
+        return true;
+    }
+
+    // measure the lines without building them
+    const qint64 taskCount = m_model->taskCount();
+    qint64 doneTasks = 0;
+    qint64 reportedTasks = 0;
+    TextTreeCursor cursor(m_model);
+    cursor.seek(0);
+    while (!cursor.atEnd())
+    {
+        m_lineHeads.push_back(cursor.head());
+        doneTasks += cursor.nextLine(nullptr);
+        m_maxColumn = max(m_maxColumn, cursor.lineWidth());
+
+        if (progress && doneTasks - reportedTasks >= PROGRESS_TASKS)
+        {
+            reportedTasks = doneTasks;
+            if (!progress(doneTasks, taskCount))
+            {
+                clear();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int TextTreeIndex::update(int firstNewId, int trackedLine)
+{
+    if (firstNewId <= 0 || m_lineHeads.empty())
+    {
+        build(m_model);
+        return -1;
+    }
+
+    // A new task has a larger id than the tasks already indexed, so it
+    // is the last child of its parent, and its lines follow all those
+    // already under the parent. The new lines thus form runs, each one
+    // inserted before an indexed line, or at the end. A run is walked by
+    // a cursor from the first line whose parent line is indexed, up to
+    // an indexed line, or a run found before which it precedes.
+    const int taskCount = m_model->taskCount();
+    const int NOT_INDEXED = -2;
+    vector<int> successors(static_cast<size_t>(max(taskCount - firstNewId, 0)), NOT_INDEXED);
+    unordered_map<int, vector<int>> runs;
+    int newLineCount = 0;
+
+    TextTreeCursor cursor(m_model);
+    for (int id = firstNewId; id < taskCount; id++)
+    {
+        const int preExecId = m_model->preExecId(id);
+        if (preExecId != -1)
+        {
+            // an exec extends the line of its chain
+            if (preExecId < firstNewId)
+            {
+                cursor.seek(chainHead(*m_model, preExecId));
+                cursor.nextLine(nullptr);
+                m_maxColumn = max(m_maxColumn, cursor.lineWidth());
+            }
+            continue;
+        }
+
+        const int parentId = m_model->parentId(id);
+        if (parentId == -1 || successors[static_cast<size_t>(id - firstNewId)] != NOT_INDEXED
+                || chainHead(*m_model, parentId) >= firstNewId)
+        {
+            continue;
+        }
+
+        vector<int> run;
+        int successor = -1;
+        cursor.seek(id);
+        while (!cursor.atEnd())
+        {
+            const int head = cursor.head();
+            if (head < firstNewId)
+            {
+                successor = head;
+                break;
+            }
+            if (successors[static_cast<size_t>(head - firstNewId)] != NOT_INDEXED)
+            {
+                successor = successors[static_cast<size_t>(head - firstNewId)];
+                break;
+            }
+            run.push_back(head);
+            cursor.nextLine(nullptr);
+            m_maxColumn = max(m_maxColumn, cursor.lineWidth());
+        }
+
+        for (int head : run)
+        {
+            successors[static_cast<size_t>(head - firstNewId)] = successor;
+        }
+        vector<int> &lines = runs[successor];
+        lines.insert(lines.begin(), run.begin(), run.end());
+        newLineCount += static_cast<int>(run.size());
+    }
+
+    if (runs.empty())
+    {
+        return trackedLine;
+    }
+
+    // splice the runs in, in one pass which does not lay anything out
+    vector<char> isSuccessor(static_cast<size_t>(firstNewId));
+    for (const auto &run : runs)
+    {
+        if (run.first != -1)
+        {
+            isSuccessor[static_cast<size_t>(run.first)] = 1;
+        }
+    }
+
+    vector<int> lineHeads;
+    lineHeads.reserve(m_lineHeads.size() + static_cast<size_t>(newLineCount));
+    int movedLine = -1;
+    for (size_t line = 0; line < m_lineHeads.size(); line++)
+    {
+        const int head = m_lineHeads[line];
+        if (isSuccessor[static_cast<size_t>(head)])
+        {
+            const vector<int> &run = runs[head];
+            lineHeads.insert(lineHeads.end(), run.begin(), run.end());
+        }
+        if (static_cast<int>(line) == trackedLine)
+        {
+            movedLine = static_cast<int>(lineHeads.size());
+        }
+        lineHeads.push_back(head);
+    }
+    const auto lastRun = runs.find(-1);
+    if (lastRun != runs.end())
+    {
+        lineHeads.insert(lineHeads.end(), lastRun->second.begin(), lastRun->second.end());
+    }
+    m_lineHeads.swap(lineHeads);
+    return movedLine;
+}
+
+void TextTreeIndex::swap(TextTreeIndex &other)
+{
+    std::swap(m_model, other.m_model);
+    m_lineHeads.swap(other.m_lineHeads);
+    std::swap(m_maxColumn, other.m_maxColumn);
+}
+
+QString TextTreeIndex::line(int line) const
+{
+    string text;
+    appendLine(line, text);
+    return QString::fromUtf8(text.data(), static_cast<int>(text.size()));
+}
+
+void TextTreeIndex::appendLine(int line, string &out) const
+{
+    TextTreeCursor cursor(m_model);
+    cursor.seek(lineHead(line));
+    cursor.nextLine(&out);
+}
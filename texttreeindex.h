@@ -0,0 +1,150 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include "progress.h"
+#include "taskmodel.h"
+
+#include <QString>
+
+#include <string>
+#include <vector>
+
+class TextLineWriter;
+
+// How the text tree is laid out
+struct TextTreeStyle
+{
+    TextTreeStyle() : compact(false), maxLevels(0) {}
+
+    // Indent every level of the tree by the same width instead of
+    // aligning the children under the description of their parent, and
+    // put each exec of a chain on a continuation line. The width of a
+    // line grows with its depth only, not with the comm values above it.
+    bool compact;
+    // in compact mode, the levels of ancestor columns shown at most, the
+    // ones above are elided into a "...N" marker, 0 shows them all
+    int maxLevels;
+};
+
+// Walks the lines of the text tree of TextLayouter with its layout
+// stack. The walk can start at any line: the stack is rebuilt from the
+// ancestors of the task starting it, their columns and whether they
+// still have children below. A cursor is cheap to copy, so a walk can be
+// split into ranges of lines rendered in parallel.
+class TextTreeCursor
+{
+public:
+    TextTreeCursor();
+    explicit TextTreeCursor(const TaskModel *model, const TextTreeStyle &style = TextTreeStyle());
+
+    // Move to the line started by the task, 0 for the first line. A
+    // compact cursor can only move to the first line.
+    void seek(int head);
+    bool atEnd() const;
+    // the task of the next line, -1 at the end
+    int head() const;
+
+    // Append the next line, without its '\n', to out if it is not null,
+    // and move past it. Returns the number of tasks in the line.
+    int nextLine(std::string *out);
+    // the width of the line last passed, in UTF-16 code units
+    int lineWidth() const { return m_lineWidth; }
+
+private:
+    // both return the number of tasks of the line
+    int nextAlignedLine(TextLineWriter &writer);
+    int nextCompactLine(TextLineWriter &writer);
+    // the columns of the first count entries of the stack, for a line
+    // whose task is at column, returns how far the columns are shifted
+    // by the elision
+    int appendCompactPrefix(TextLineWriter &writer, size_t count, int column);
+
+private:
+    // a task with children, and the column of its description
+    struct Entry
+    {
+        Entry(int _id, int _x, int _nextChild) : id(_id), x(_x), nextChild(_nextChild) {}
+
+        int id;
+        int x;
+        int nextChild;
+    };
+
+    const TaskModel *m_model;
+    TextTreeStyle m_style;
+    // the idle line is next, it has no parent to take it from
+    bool m_atRoot;
+    std::vector<Entry> m_stack;
+    int m_lineWidth;
+
+    // compact style: the exec task of the next continuation line, -1 if
+    // there is none, and the column of the head of its chain
+    int m_pendingExec;
+    int m_chainX;
+};
+
+// The lines of the text tree of TextLayouter, each one known by the task
+// which starts it. A line is rendered from the model on demand: its
+// prefix only depends on the columns of its ancestors, which are found
+// again by walking the parent links up to idle. Indexing does not build
+// any text, so it costs a few bytes per line.
+class TextTreeIndex
+{
+public:
+    TextTreeIndex();
+
+    // Index the lines of model, which must stay alive and unchanged
+    // until the next call. Returns false if progress cancelled it.
+    bool build(const TaskModel *model, const ProgressCallback &progress = ProgressCallback());
+    // The tasks from firstNewId on have been appended to the model: index
+    // their lines only, 0 indexes the model again. Returns the line now
+    // holding the task of trackedLine, -1 for -1. The widest line is not
+    // measured again, so a line which got narrower, e.g. a task which
+    // stopped living, keeps maxColumn().
+    int update(int firstNewId, int trackedLine = -1);
+    // refer to model, which holds what the indexed one held, e.g. after
+    // TaskModel::swap()
+    void setModel(const TaskModel *model) { m_model = model; }
+    void swap(TextTreeIndex &other);
+    void clear();
+
+    int lineCount() const { return static_cast<int>(m_lineHeads.size()); }
+    // the task starting the line, the others of the line are its exec chain
+    int lineHead(int line) const { return m_lineHeads[static_cast<size_t>(line)]; }
+    // the width of the widest line, in UTF-16 code units
+    int maxColumn() const { return m_maxColumn; }
+
+    // the line exactly as TextLayouter writes it, without the '\n'
+    QString line(int line) const;
+    // the same in UTF-8, appended to out
+    void appendLine(int line, std::string &out) const;
+
+private:
+    const TaskModel *m_model;
+    std::vector<int> m_lineHeads;
+    int m_maxColumn;
+};
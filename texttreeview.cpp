@@ -0,0 +1,293 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#include "texttreeview.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+#include <algorithm>
+
+TextTreeView::TextTreeView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , m_currentLine(-1)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setAutoFillBackground(true);
+}
+
+void TextTreeView::setModel(const TaskModelPtr &model, const std::shared_ptr<TextTreeIndex> &index)
+{
+    m_model = model;
+    if (index)
+    {
+        m_index.swap(*index);
+        m_index.setModel(m_model.get());
+    }
+    else
+    {
+        m_index.build(m_model.get());
+    }
+    m_currentLine = -1;
+
+    updateScrollBars();
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    viewport()->update();
+}
+
+void TextTreeView::updateLines(int firstNewId)
+{
+    // new tasks insert lines anywhere, follow the task of the current line
+    m_currentLine = m_index.update(firstNewId, m_currentLine);
+
+    updateScrollBars();
+    viewport()->update();
+}
+
+int TextTreeView::currentLine() const
+{
+    return m_currentLine;
+}
+
+void TextTreeView::setCurrentLine(int line)
+{
+    if (line < -1 || line >= m_index.lineCount())
+    {
+        return;
+    }
+
+    m_currentLine = line;
+    if (line != -1)
+    {
+        ensureLineVisible(line);
+    }
+    viewport()->update();
+}
+
+bool TextTreeView::find(const QString &text, bool backward)
+{
+    const int lineCount = m_index.lineCount();
+    if (!m_model || text.isEmpty() || lineCount == 0)
+    {
+        return false;
+    }
+
+    // there are far fewer comm values than tasks
+    std::vector<char> commMatches(static_cast<size_t>(m_model->commCount()));
+    for (int i = 0; i < m_model->commCount(); i++)
+    {
+        commMatches[static_cast<size_t>(i)] = m_model->commName(i).contains(text, Qt::CaseInsensitive);
+    }
+    bool isPid = false;
+    const int pid = text.toInt(&isPid);
+
+    int line = m_currentLine;
+    if (line == -1)
+    {
+        line = backward ? 0 : lineCount - 1;
+    }
+    for (int i = 0; i < lineCount; i++)
+    {
+        if (backward)
+        {
+            line = line == 0 ? lineCount - 1 : line - 1;
+        }
+        else
+        {
+            line = line == lineCount - 1 ? 0 : line + 1;
+        }
+
+        for (int id = m_index.lineHead(line); id != -1; id = m_model->postExecId(id))
+        {
+            if (commMatches[static_cast<size_t>(m_model->commId(id))] || (isPid && m_model->pid(id) == pid))
+            {
+                setCurrentLine(line);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TextTreeView::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+
+    const int height = lineHeight();
+    const int width = columnWidth();
+    const int ascent = fontMetrics().ascent();
+    const QRect dirty = event->rect();
+
+    // only the columns in the viewport are drawn, a deep line starts
+    // with hundreds of them
+    const int xOffset = horizontalScrollBar()->value();
+    const int firstColumn = xOffset / width;
+    const int columnCount = viewport()->width() / width + 2;
+    const int x = firstColumn * width - xOffset;
+
+    const int firstLine = verticalScrollBar()->value();
+    const int lineCount = m_index.lineCount();
+    int y = 0;
+    for (int line = firstLine; line < lineCount && y <= dirty.bottom(); line++, y += height)
+    {
+        if (y + height <= dirty.top())
+        {
+            continue;
+        }
+
+        if (line == m_currentLine)
+        {
+            painter.fillRect(0, y, viewport()->width(), height, palette().highlight());
+            painter.setPen(palette().color(QPalette::HighlightedText));
+        }
+        else
+        {
+            painter.setPen(palette().color(QPalette::Text));
+        }
+        painter.drawText(x, y + ascent, m_index.line(line).mid(firstColumn, columnCount));
+    }
+}
+
+void TextTreeView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void TextTreeView::keyPressEvent(QKeyEvent *event)
+{
+    if (event->matches(QKeySequence::Copy))
+    {
+        if (m_currentLine != -1)
+        {
+            QApplication::clipboard()->setText(m_index.line(m_currentLine));
+        }
+        return;
+    }
+
+    const int lastLine = m_index.lineCount() - 1;
+    if (lastLine < 0)
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    const int line = m_currentLine == -1 ? verticalScrollBar()->value() : m_currentLine;
+    switch (event->key())
+    {
+    case Qt::Key_Up:
+        setCurrentLine(std::max(line - 1, 0));
+        break;
+    case Qt::Key_Down:
+        setCurrentLine(std::min(line + 1, lastLine));
+        break;
+    case Qt::Key_PageUp:
+        setCurrentLine(std::max(line - pageLineCount(), 0));
+        break;
+    case Qt::Key_PageDown:
+        setCurrentLine(std::min(line + pageLineCount(), lastLine));
+        break;
+    case Qt::Key_Home:
+        setCurrentLine(0);
+        break;
+    case Qt::Key_End:
+        setCurrentLine(lastLine);
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        break;
+    }
+}
+
+void TextTreeView::mousePressEvent(QMouseEvent *event)
+{
+    const int line = verticalScrollBar()->value() + event->pos().y() / lineHeight();
+    if (line < m_index.lineCount())
+    {
+        setCurrentLine(line);
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void TextTreeView::changeEvent(QEvent *event)
+{
+    QAbstractScrollArea::changeEvent(event);
+    if (event->type() == QEvent::FontChange)
+    {
+        updateScrollBars();
+        viewport()->update();
+    }
+}
+
+int TextTreeView::lineHeight() const
+{
+    return std::max(fontMetrics().height(), 1);
+}
+
+int TextTreeView::columnWidth() const
+{
+    return std::max(fontMetrics().horizontalAdvance(QLatin1Char('0')), 1);
+}
+
+int TextTreeView::pageLineCount() const
+{
+    return std::max(viewport()->height() / lineHeight(), 1);
+}
+
+void TextTreeView::updateScrollBars()
+{
+    const int page = pageLineCount();
+    verticalScrollBar()->setRange(0, std::max(m_index.lineCount() - page, 0));
+    verticalScrollBar()->setPageStep(page);
+    verticalScrollBar()->setSingleStep(1);
+
+    const int width = columnWidth();
+    const int contentWidth = (m_index.maxColumn() + 1) * width;
+    horizontalScrollBar()->setRange(0, std::max(contentWidth - viewport()->width(), 0));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(width);
+}
+
+void TextTreeView::ensureLineVisible(int line)
+{
+    const int first = verticalScrollBar()->value();
+    const int page = pageLineCount();
+    if (line < first)
+    {
+        verticalScrollBar()->setValue(line);
+    }
+    else if (line >= first + page)
+    {
+        verticalScrollBar()->setValue(line - page + 1);
+    }
+}
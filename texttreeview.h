@@ -0,0 +1,84 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+
+#pragma once
+
+#include "taskmodel.h"
+#include "texttreeindex.h"
+
+#include <QAbstractScrollArea>
+
+#include <memory>
+#include <vector>
+
+// Shows the text tree of a TaskModel. Only the lines in the viewport are
+// rendered, from a TextTreeIndex, so opening and scrolling a tree of
+// millions of lines costs what is visible. The font is monospace, one
+// UTF-16 code unit takes one column.
+class TextTreeView : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    explicit TextTreeView(QWidget *parent = nullptr);
+
+    // Show model with its lines in index, e.g. built by ModelLoader on
+    // its worker thread, which the view takes. Without an index the lines
+    // are indexed here.
+    void setModel(const TaskModelPtr &model, const std::shared_ptr<TextTreeIndex> &index = nullptr);
+    // The tasks from firstNewId on have been appended to the model in
+    // place: index their lines, keeping the scroll position and the
+    // current line.
+    void updateLines(int firstNewId);
+
+    // the selected line, -1 if there is none
+    int currentLine() const;
+    void setCurrentLine(int line);
+
+    // Select the next line, or the previous one, with a task whose comm
+    // contains text or whose pid is text. The search wraps around and
+    // returns false if no line matches.
+    bool find(const QString &text, bool backward = false);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void changeEvent(QEvent *event) override;
+
+private:
+    int lineHeight() const;
+    int columnWidth() const;
+    // lines fully in the viewport
+    int pageLineCount() const;
+
+    void updateScrollBars();
+    void ensureLineVisible(int line);
+
+private:
+    TaskModelPtr m_model;
+    TextTreeIndex m_index;
+    int m_currentLine;
+};
@@ -0,0 +1,934 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "timelinecanvas.h"
+
+#include <QFontMetricsF>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QToolTip>
+#include <QWheelEvent>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <assert.h>
+
+using namespace std;
+
+namespace
+{
+
+// a living task lasts forever as far as the layout is concerned
+const int64_t LIVING_END = numeric_limits<int64_t>::max();
+
+const int TEXT_PADDING = 4;
+
+}
+
+TimeLineCanvas::TimeLineCanvas(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , m_unitWidth(0.00001)
+    , m_unitHeight(25)
+    , m_hideKthread(false)
+    , m_packRows(false)
+    , m_maxStopTime(0)
+    , m_maxCommWidth(0)
+    , m_digitWidth(0)
+    , m_bracketWidth(0)
+    , m_livingWidth(0)
+    , m_startedBeforeWidth(0)
+    , m_tilesComplete(false)
+    , m_fallbackUnitWidth(0)
+    , m_fallbackUnitHeight(0)
+    , m_dragging(false)
+{
+    viewport()->setCursor(Qt::OpenHandCursor);
+
+    connect(&m_tiles, &TimeLineTiles::tileReady, viewport(), static_cast<void (QWidget::*)()>(&QWidget::update));
+}
+
+void TimeLineCanvas::setModel(const TaskModelPtr &model)
+{
+    assert(model);
+    m_model = model;
+
+    m_commColor.clear();
+    m_commTextWidth.clear();
+    updateComms();
+
+    const int taskCount = m_model->taskCount();
+
+    m_maxStopTime = 0;
+    for (int i = 0; i < taskCount; i++)
+    {
+        m_maxStopTime = max(m_maxStopTime, m_model->stopTime(i));
+    }
+
+    relayout();
+}
+
+void TimeLineCanvas::appendTasks(int firstNewId, const std::vector<int> &stoppedIds)
+{
+    assert(m_model);
+
+    const int taskCount = m_model->taskCount();
+    assert(static_cast<size_t>(firstNewId) == m_taskRow.size());
+
+    for (int id : stoppedIds)
+    {
+        if (id >= firstNewId)
+        {
+            continue;
+        }
+
+        const Task &t = m_model->task(id);
+        m_maxStopTime = max(m_maxStopTime, t.stopTime());
+
+        // the row of a living task is reserved until it stops
+        const int row = m_taskRow[static_cast<size_t>(id)];
+        if (m_packRows && row != -1 && m_packedRows[static_cast<size_t>(row)].back() == id)
+        {
+            setPackedRowEnd(row, taskEnd(t));
+            m_density.stopTask(row, id, t.startTime(), t.stopTime());
+        }
+    }
+
+    updateComms();
+
+    m_taskRow.resize(static_cast<size_t>(taskCount), -1);
+    for (int i = firstNewId; i < taskCount; i++)
+    {
+        m_maxStopTime = max(m_maxStopTime, m_model->stopTime(i));
+        layoutTask(i);
+    }
+
+    // the old tiles are shown until the new ones are ready
+    m_tiles.invalidate();
+
+    updateScrollBars();
+    viewport()->update();
+    emit visibleRangeChanged();
+}
+
+qreal TimeLineCanvas::unitWidth() const
+{
+    return m_unitWidth;
+}
+
+qreal TimeLineCanvas::unitHeight() const
+{
+    return m_unitHeight;
+}
+
+void TimeLineCanvas::setUnitSize(qreal unitWidth, qreal unitHeight)
+{
+    setUnitSize(unitWidth, unitHeight, viewport()->rect().center());
+}
+
+void TimeLineCanvas::setUnitSize(qreal unitWidth, qreal unitHeight, const QPoint &anchor)
+{
+    if (unitWidth == m_unitWidth && unitHeight == m_unitHeight)
+    {
+        return;
+    }
+
+    const qreal anchorTime = (horizontalScrollBar()->value() + anchor.x()) / m_unitWidth;
+    const qreal anchorRow = (verticalScrollBar()->value() + anchor.y()) / m_unitHeight;
+
+    // nothing is laid out again, the tiles of the old zoom are scaled
+    // until the ones of the new zoom are ready
+    if (m_tilesComplete)
+    {
+        m_fallbackUnitWidth = m_unitWidth;
+        m_fallbackUnitHeight = m_unitHeight;
+    }
+    m_tilesComplete = false;
+
+    m_unitWidth = unitWidth;
+    m_unitHeight = unitHeight;
+
+    updateScrollBars();
+    horizontalScrollBar()->setValue(qRound(anchorTime * m_unitWidth - anchor.x()));
+    verticalScrollBar()->setValue(qRound(anchorRow * m_unitHeight - anchor.y()));
+
+    viewport()->update();
+    emit visibleRangeChanged();
+}
+
+bool TimeLineCanvas::hideKthread() const
+{
+    return m_hideKthread;
+}
+
+void TimeLineCanvas::setHideKthread(bool hide)
+{
+    if (m_hideKthread != hide)
+    {
+        m_hideKthread = hide;
+        relayout();
+    }
+}
+
+bool TimeLineCanvas::packRows() const
+{
+    return m_packRows;
+}
+
+void TimeLineCanvas::setPackRows(bool pack)
+{
+    if (m_packRows != pack)
+    {
+        m_packRows = pack;
+        relayout();
+    }
+}
+
+int TimeLineCanvas::tileCacheSize() const
+{
+    return m_tiles.cacheSize();
+}
+
+void TimeLineCanvas::setTileCacheSize(int kilobytes)
+{
+    m_tiles.setCacheSize(kilobytes);
+}
+
+int TimeLineCanvas::rowCount() const
+{
+    return static_cast<int>(m_packRows ? m_packedRows.size() : m_rowTask.size());
+}
+
+int64_t TimeLineCanvas::maxStopTime() const
+{
+    return m_maxStopTime;
+}
+
+int64_t TimeLineCanvas::visibleStartTime() const
+{
+    return static_cast<int64_t>(horizontalScrollBar()->value() / m_unitWidth);
+}
+
+int64_t TimeLineCanvas::visibleStopTime() const
+{
+    return static_cast<int64_t>((horizontalScrollBar()->value() + contentRight()) / m_unitWidth);
+}
+
+int TimeLineCanvas::contentRight() const
+{
+    const qreal right = contentWidth() - horizontalScrollBar()->value();
+    return static_cast<int>(qBound<qreal>(0, right, viewport()->width()));
+}
+
+int TimeLineCanvas::taskAt(const QPoint &pos) const
+{
+    if (!m_model)
+    {
+        return -1;
+    }
+
+    const qreal y = verticalScrollBar()->value() + pos.y();
+    const int row = static_cast<int>(floor(y / m_unitHeight));
+    if (row < 0 || row >= rowCount())
+    {
+        return -1;
+    }
+
+    // tasks shorter than a pixel are drawn one pixel wide
+    const qreal x = horizontalScrollBar()->value() + pos.x();
+    const int64_t time = static_cast<int64_t>(floor(x / m_unitWidth));
+    const int64_t pixelTime = static_cast<int64_t>(ceil(1 / m_unitWidth));
+
+    const int *end = rowEnd(row);
+    const int *it = lower_bound(rowBegin(row), end, time - pixelTime, [this](int id, int64_t t) {
+        return taskEnd(m_model->task(id)) < t;
+    });
+
+    // the nearest of the tasks within a pixel
+    int result = -1;
+    int64_t distance = numeric_limits<int64_t>::max();
+    for (; it != end && m_model->task(*it).startTime() <= time; ++it)
+    {
+        const Task &t = m_model->task(*it);
+        const int64_t d = max<int64_t>(0, time - taskEnd(t));
+        if (d <= pixelTime && d < distance)
+        {
+            result = *it;
+            distance = d;
+        }
+    }
+    return result;
+}
+
+void TimeLineCanvas::centerOnTask(int id)
+{
+    if (!m_model || id < 0 || static_cast<size_t>(id) >= m_taskRow.size())
+    {
+        return;
+    }
+
+    const int row = m_taskRow[static_cast<size_t>(id)];
+    if (row == -1)
+    {
+        return;
+    }
+
+    const Task &t = m_model->task(id);
+    const qreal centerTime = t.stopTime() == -1 ? t.startTime() : t.startTime() + t.duration() / 2.0;
+    const qreal centerY = (row + 0.5) * m_unitHeight;
+
+    horizontalScrollBar()->setValue(qRound(centerTime * m_unitWidth - viewport()->width() / 2.0));
+    verticalScrollBar()->setValue(qRound(centerY - viewport()->height() / 2.0));
+}
+
+void TimeLineCanvas::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().base());
+
+    if (!m_model || rowCount() == 0)
+    {
+        return;
+    }
+
+    const int scrollX = horizontalScrollBar()->value();
+    const int scrollY = verticalScrollBar()->value();
+
+    // the part of the content inside the viewport, in content coordinates
+    const QRect content(0, 0, static_cast<int>(ceil(contentWidth())), static_cast<int>(ceil(contentHeight())));
+    const QRect visible = content & QRect(QPoint(scrollX, scrollY), viewport()->size());
+    if (visible.isEmpty())
+    {
+        return;
+    }
+
+    const int tileSize = TimeLineTiles::TILE_SIZE;
+    const int firstX = visible.left() / tileSize;
+    const int lastX = visible.right() / tileSize;
+    const int firstY = visible.top() / tileSize;
+    const int lastY = visible.bottom() / tileSize;
+
+    QSet<TimeLineTileKey> wanted;
+    for (int y = firstY; y <= lastY; y++)
+    {
+        for (int x = firstX; x <= lastX; x++)
+        {
+            wanted.insert(TimeLineTileKey{m_unitWidth, m_unitHeight, x, y});
+        }
+    }
+    m_tiles.setWanted(wanted);
+
+    const QRect clip = visible.translated(-scrollX, -scrollY);
+    painter.setClipRect(clip);
+
+    QRegion missing;
+    for (int y = firstY; y <= lastY; y++)
+    {
+        for (int x = firstX; x <= lastX; x++)
+        {
+            const TimeLineTileKey key{m_unitWidth, m_unitHeight, x, y};
+            if (m_tiles.needsRender(key))
+            {
+                requestTile(key);
+            }
+
+            const QPoint pos(x * tileSize - scrollX, y * tileSize - scrollY);
+            const QImage *image = m_tiles.tile(key);
+            if (image)
+            {
+                painter.drawImage(pos, *image);
+            }
+            else
+            {
+                missing += QRect(pos, QSize(tileSize, tileSize));
+            }
+        }
+    }
+
+    if (missing.isEmpty())
+    {
+        m_tilesComplete = true;
+        return;
+    }
+
+    painter.setClipRegion(missing & clip);
+    painter.fillRect(clip, palette().alternateBase());
+    paintFallback(painter, missing);
+}
+
+void TimeLineCanvas::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+    emit visibleRangeChanged();
+}
+
+void TimeLineCanvas::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+
+    viewport()->update();
+    emit visibleRangeChanged();
+}
+
+void TimeLineCanvas::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+    {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+
+    m_dragging = true;
+    m_dragStartPos = event->pos();
+    m_dragStartScroll = QPoint(horizontalScrollBar()->value(), verticalScrollBar()->value());
+    viewport()->setCursor(Qt::ClosedHandCursor);
+    event->accept();
+}
+
+void TimeLineCanvas::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!m_dragging)
+    {
+        QAbstractScrollArea::mouseMoveEvent(event);
+        return;
+    }
+
+    const QPoint delta = event->pos() - m_dragStartPos;
+    horizontalScrollBar()->setValue(m_dragStartScroll.x() - delta.x());
+    verticalScrollBar()->setValue(m_dragStartScroll.y() - delta.y());
+    event->accept();
+}
+
+void TimeLineCanvas::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!m_dragging || event->button() != Qt::LeftButton)
+    {
+        QAbstractScrollArea::mouseReleaseEvent(event);
+        return;
+    }
+
+    m_dragging = false;
+    viewport()->setCursor(Qt::OpenHandCursor);
+    event->accept();
+}
+
+void TimeLineCanvas::wheelEvent(QWheelEvent *event)
+{
+    if (!(event->modifiers() & Qt::ControlModifier))
+    {
+        QAbstractScrollArea::wheelEvent(event);
+        return;
+    }
+
+    emit zoomRequested(event->angleDelta().y(), event->position().toPoint());
+    event->accept();
+}
+
+void TimeLineCanvas::changeEvent(QEvent *event)
+{
+    QAbstractScrollArea::changeEvent(event);
+
+    if (event->type() == QEvent::FontChange)
+    {
+        m_commTextWidth.clear();
+        updateComms();
+        m_tiles.clear();
+        updateScrollBars();
+        viewport()->update();
+    }
+}
+
+bool TimeLineCanvas::viewportEvent(QEvent *event)
+{
+    if (event->type() == QEvent::ToolTip)
+    {
+        QHelpEvent *helpEvent = static_cast<QHelpEvent *>(event);
+        const int id = taskAt(helpEvent->pos());
+        if (id == -1)
+        {
+            QToolTip::hideText();
+            event->ignore();
+        }
+        else
+        {
+            QToolTip::showText(helpEvent->globalPos(), toolTipText(id), viewport());
+        }
+        return true;
+    }
+
+    return QAbstractScrollArea::viewportEvent(event);
+}
+
+QColor TimeLineCanvas::generateBrightColor(uint32_t hash)
+{
+    // FNV-1a of short similar names differs mostly in the low bits,
+    // spread them over all the bytes first
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    const uint8_t a = static_cast<uint8_t>(hash);
+    const uint8_t b = static_cast<uint8_t>(hash >> 8);
+    const uint8_t c = static_cast<uint8_t>(hash >> 16);
+
+    static const qreal H_MIN = 0.0;
+    static const qreal H_MAX = 1.0;
+    static const qreal S_MIN = 0.0;
+    static const qreal S_MAX = 1.0;
+    static const qreal V_MIN = 0.7;
+    static const qreal V_MAX = 1.0;
+
+    const qreal h = H_MIN + (H_MAX - H_MIN) * a / 256;
+    const qreal s = S_MIN + (S_MAX - S_MIN) * b / 256;
+    const qreal v = V_MIN + (V_MAX - V_MIN) * c / 256;
+
+    QColor result;
+    result.setHsvF(h, s, v);
+    return result;
+}
+
+int64_t TimeLineCanvas::taskEnd(const Task &t)
+{
+    return t.stopTime() == -1 ? LIVING_END : t.stopTime();
+}
+
+QString TimeLineCanvas::timeText(int64_t time)
+{
+    return QString::number(time / 1000000.0, 'f', 6) + " s";
+}
+
+QString TimeLineCanvas::toolTipText(int id) const
+{
+    const Task &t = m_model->task(id);
+
+    // an exec replaces the image of its process, the parent is the one of the fork
+    int forkId = id;
+    while (m_model->task(forkId).preExecId() != -1)
+    {
+        forkId = m_model->task(forkId).preExecId();
+    }
+    const int parentId = m_model->task(forkId).parentId();
+
+    QString text = QString("pid: %1\ncomm: %2\nstart: %3\n").arg(t.pid()).arg(t.comm()).arg(timeText(t.startTime()));
+    if (t.stopTime() == -1)
+    {
+        text += "stop: living";
+    }
+    else
+    {
+        text += QString("stop: %1\nduration: %2").arg(timeText(t.stopTime())).arg(timeText(t.duration()));
+    }
+    if (parentId != -1)
+    {
+        text += "\nparent: " + m_model->task(parentId).description();
+    }
+    return text;
+}
+
+void TimeLineCanvas::updateComms()
+{
+    const QFontMetricsF fm(font());
+    if (m_commTextWidth.empty())
+    {
+        m_digitWidth = fm.horizontalAdvance(QLatin1Char('0'));
+        m_bracketWidth = fm.horizontalAdvance(QLatin1String("[] "));
+        m_livingWidth = fm.horizontalAdvance(QLatin1String("(living)"));
+        m_startedBeforeWidth = fm.horizontalAdvance(QLatin1String("(started before)"));
+        m_maxCommWidth = 0;
+    }
+
+    // only the comm values which are new since the last call
+    const int commCount = m_model ? m_model->commCount() : 0;
+    for (int i = static_cast<int>(m_commColor.size()); i < commCount; i++)
+    {
+        m_commColor.push_back(generateBrightColor(m_model->commHash(i)).rgb());
+    }
+    for (int i = static_cast<int>(m_commTextWidth.size()); i < commCount; i++)
+    {
+        const qreal w = fm.horizontalAdvance(m_model->commName(i));
+        m_commTextWidth.push_back(w);
+        m_maxCommWidth = max(m_maxCommWidth, w);
+    }
+}
+
+qreal TimeLineCanvas::descriptionWidth(const Task &t) const
+{
+    // Task::description(), "[pid] comm(started before)(living)", digits
+    // have the same width in most fonts
+    int digits = 1;
+    for (int pid = t.pid(); pid >= 10; pid /= 10)
+    {
+        digits++;
+    }
+
+    qreal result = m_bracketWidth + digits * m_digitWidth + m_commTextWidth[static_cast<size_t>(t.commId())];
+    if (t.startClamped())
+    {
+        result += m_startedBeforeWidth;
+    }
+    if (t.stopTime() == -1 || t.stopClamped())
+    {
+        result += m_livingWidth;
+    }
+    return result;
+}
+
+qreal TimeLineCanvas::textMargin() const
+{
+    // pid_max is at most 4194304
+    static const int MAX_PID_DIGITS = 7;
+    return TEXT_PADDING + m_bracketWidth + MAX_PID_DIGITS * m_digitWidth + m_maxCommWidth
+            + m_startedBeforeWidth + m_livingWidth;
+}
+
+bool TimeLineCanvas::taskShouldShow(int id) const
+{
+    const Task &t = m_model->task(id);
+    if (m_hideKthread && t.kthread())
+    {
+        return false;
+    }
+    return true;
+}
+
+bool TimeLineCanvas::textShouldShow() const
+{
+    return m_unitHeight >= 20;
+}
+
+void TimeLineCanvas::requestTile(const TimeLineTileKey &key)
+{
+    const int tileSize = TimeLineTiles::TILE_SIZE;
+    const QRect rect(key.x * tileSize, key.y * tileSize, tileSize, tileSize);
+
+    std::shared_ptr<TimeLineTileJob> job = std::make_shared<TimeLineTileJob>();
+    job->key = key;
+    job->font = font();
+    job->textColor = Qt::black;
+    job->background = palette().base().color();
+    job->textFlags = Qt::AlignLeft | Qt::AlignVCenter;
+    job->textPadding = TEXT_PADDING;
+    job->devicePixelRatio = devicePixelRatioF();
+
+    // many tasks share a pixel column only when rows are packed
+    const int level = m_packRows ? TimeLineDensity::levelFor(1 / m_unitWidth) : -1;
+    if (level >= 0)
+    {
+        collectDensity(level, rect, *job);
+    }
+    else
+    {
+        collectTasks(rect, *job);
+    }
+
+    m_tiles.render(job);
+}
+
+void TimeLineCanvas::paintFallback(QPainter &painter, const QRegion &missing)
+{
+    // zooming out far would need too many old tiles, the placeholder will do
+    static const int MAX_FALLBACK_TILES = 256;
+
+    if (m_fallbackUnitWidth <= 0 || m_fallbackUnitHeight <= 0)
+    {
+        return;
+    }
+
+    const int scrollX = horizontalScrollBar()->value();
+    const int scrollY = verticalScrollBar()->value();
+    const qreal sx = m_unitWidth / m_fallbackUnitWidth;
+    const qreal sy = m_unitHeight / m_fallbackUnitHeight;
+
+    // the missing part of the viewport in the content coordinates of the fallback zoom
+    const QRect bounds = missing.boundingRect().translated(scrollX, scrollY);
+    const QRectF area(bounds.left() / sx, bounds.top() / sy, bounds.width() / sx, bounds.height() / sy);
+
+    const int tileSize = TimeLineTiles::TILE_SIZE;
+    const int firstX = max(0, static_cast<int>(area.left() / tileSize));
+    const int lastX = static_cast<int>(area.right() / tileSize);
+    const int firstY = max(0, static_cast<int>(area.top() / tileSize));
+    const int lastY = static_cast<int>(area.bottom() / tileSize);
+    if ((lastX - firstX + 1) * (lastY - firstY + 1) > MAX_FALLBACK_TILES)
+    {
+        return;
+    }
+
+    painter.save();
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.translate(-scrollX, -scrollY);
+    painter.scale(sx, sy);
+
+    for (int y = firstY; y <= lastY; y++)
+    {
+        for (int x = firstX; x <= lastX; x++)
+        {
+            const QImage *image = m_tiles.tile(TimeLineTileKey{m_fallbackUnitWidth, m_fallbackUnitHeight, x, y});
+            if (image)
+            {
+                painter.drawImage(QPointF(x * tileSize, y * tileSize), *image);
+            }
+        }
+    }
+
+    painter.restore();
+}
+
+void TimeLineCanvas::collectTasks(const QRect &rect, TimeLineTileJob &job) const
+{
+    const int firstRow = max(0, static_cast<int>(rect.top() / m_unitHeight));
+    const int lastRow = min(rowCount() - 1, static_cast<int>(rect.bottom() / m_unitHeight));
+
+    const int64_t startTime = static_cast<int64_t>(rect.left() / m_unitWidth);
+    const int64_t stopTime = static_cast<int64_t>((rect.right() + 1) / m_unitWidth) + 1;
+
+    const bool showText = textShouldShow();
+
+    // without packing nothing follows in the row, the text may overflow
+    // into the tiles on the right, as far as the longest text reaches
+    int64_t searchTime = startTime;
+    if (showText && !m_packRows)
+    {
+        job.textFlags |= Qt::TextDontClip;
+        searchTime = max<int64_t>(0, startTime - static_cast<int64_t>(textMargin() / m_unitWidth));
+    }
+
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+        const int *end = rowEnd(row);
+
+        // tasks of a row do not overlap, so their ends are sorted as well
+        const int *it = lower_bound(rowBegin(row), end, searchTime, [this](int id, int64_t time) {
+            return taskEnd(m_model->task(id)) < time;
+        });
+
+        const qreal y = row * m_unitHeight - rect.top();
+        for (; it != end; ++it)
+        {
+            const Task &t = m_model->task(*it);
+            if (t.startTime() > stopTime)
+            {
+                break;
+            }
+
+            const qreal x = t.startTime() * m_unitWidth - rect.left();
+            const qreal w = t.stopTime() == -1 ? rect.width() - x : max<qreal>(1, t.duration() * m_unitWidth);
+            if (x + max(w, TEXT_PADDING + descriptionWidth(t)) < 0)
+            {
+                // only looked at for its text, which ends before the tile
+                continue;
+            }
+
+            TimeLineTileJob::Item item;
+            item.rect = QRectF(x, y, w, m_unitHeight);
+            item.color = m_commColor[static_cast<size_t>(t.commId())];
+            if (showText)
+            {
+                item.text = t.description();
+            }
+            job.items.push_back(item);
+        }
+    }
+}
+
+void TimeLineCanvas::collectDensity(int level, const QRect &rect, TimeLineTileJob &job) const
+{
+    // a span which is barely busy must not vanish
+    static const qreal MIN_OPACITY = 0.3;
+
+    const int firstRow = max(0, static_cast<int>(rect.top() / m_unitHeight));
+    const int lastRow = min(rowCount() - 1, static_cast<int>(rect.bottom() / m_unitHeight));
+
+    const int64_t startTime = static_cast<int64_t>(rect.left() / m_unitWidth);
+    const int64_t stopTime = static_cast<int64_t>((rect.right() + 1) / m_unitWidth) + 1;
+
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+        const std::vector<TimeLineDensity::Span> &spans = m_density.spans(row, level);
+
+        auto it = lower_bound(spans.begin(), spans.end(), startTime, [](const TimeLineDensity::Span &s, int64_t time) {
+            return s.stop < time;
+        });
+
+        const qreal y = row * m_unitHeight - rect.top();
+        for (; it != spans.end() && it->start <= stopTime; ++it)
+        {
+            const TimeLineDensity::Span &s = *it;
+            const qreal x = s.start * m_unitWidth - rect.left();
+            const bool living = (s.stop == LIVING_END);
+            const qreal w = living ? rect.width() - x : max<qreal>(1, (s.stop - s.start) * m_unitWidth);
+
+            qreal opacity = 1;
+            if (!living && s.stop > s.start)
+            {
+                opacity = max(MIN_OPACITY, min<qreal>(1, static_cast<qreal>(s.busy) / (s.stop - s.start)));
+            }
+
+            QColor c(m_commColor[static_cast<size_t>(m_model->commId(s.dominantId))]);
+            c.setAlphaF(opacity);
+
+            TimeLineTileJob::Item item;
+            item.rect = QRectF(x, y, w, m_unitHeight);
+            item.color = c.rgba();
+            job.items.push_back(item);
+        }
+    }
+}
+
+void TimeLineCanvas::relayout()
+{
+    m_taskRow.clear();
+    m_rowTask.clear();
+    m_packedRows.clear();
+    m_packedRowEnd.clear();
+    m_freeRows = decltype(m_freeRows)();
+    m_density.clear();
+    m_tiles.clear();
+
+    if (m_model)
+    {
+        const int taskCount = m_model->taskCount();
+        m_taskRow.resize(static_cast<size_t>(taskCount), -1);
+        for (int i = 0; i < taskCount; i++)
+        {
+            layoutTask(i);
+        }
+    }
+
+    updateScrollBars();
+    viewport()->update();
+    emit visibleRangeChanged();
+}
+
+void TimeLineCanvas::layoutTask(int id)
+{
+    if (!taskShouldShow(id))
+    {
+        return;
+    }
+
+    if (!m_packRows)
+    {
+        m_taskRow[static_cast<size_t>(id)] = static_cast<int>(m_rowTask.size());
+        m_rowTask.push_back(id);
+        return;
+    }
+
+    // Tasks arrive in start time order, so the row which got free
+    // first is the best fit. Greedy packing like this needs as many
+    // rows as tasks run at the same time at most.
+    const Task &t = m_model->task(id);
+
+    int row = -1;
+    while (!m_freeRows.empty())
+    {
+        const RowEnd top = m_freeRows.top();
+        if (top.first != m_packedRowEnd[static_cast<size_t>(top.second)])
+        {
+            m_freeRows.pop();
+            continue;
+        }
+        if (top.first <= t.startTime())
+        {
+            row = top.second;
+            m_freeRows.pop();
+        }
+        break;
+    }
+
+    if (row == -1)
+    {
+        row = static_cast<int>(m_packedRows.size());
+        m_packedRows.emplace_back();
+        m_packedRowEnd.push_back(0);
+        m_density.addRow();
+    }
+
+    m_taskRow[static_cast<size_t>(id)] = row;
+    m_packedRows[static_cast<size_t>(row)].push_back(id);
+    setPackedRowEnd(row, taskEnd(t));
+    m_density.appendTask(row, id, t.startTime(), taskEnd(t));
+}
+
+void TimeLineCanvas::setPackedRowEnd(int row, int64_t end)
+{
+    m_packedRowEnd[static_cast<size_t>(row)] = end;
+    if (end != LIVING_END)
+    {
+        m_freeRows.push(RowEnd(end, row));
+    }
+}
+
+const int *TimeLineCanvas::rowBegin(int row) const
+{
+    if (m_packRows)
+    {
+        return m_packedRows[static_cast<size_t>(row)].data();
+    }
+    return m_rowTask.data() + row;
+}
+
+const int *TimeLineCanvas::rowEnd(int row) const
+{
+    if (m_packRows)
+    {
+        const std::vector<int> &tasks = m_packedRows[static_cast<size_t>(row)];
+        return tasks.data() + tasks.size();
+    }
+    return m_rowTask.data() + row + 1;
+}
+
+qreal TimeLineCanvas::contentWidth() const
+{
+    // room for the description of the tasks at the very end
+    return m_maxStopTime * m_unitWidth + (textShouldShow() ? textMargin() : 0);
+}
+
+qreal TimeLineCanvas::contentHeight() const
+{
+    return rowCount() * m_unitHeight;
+}
+
+void TimeLineCanvas::updateScrollBars()
+{
+    static const qreal MAX_RANGE = numeric_limits<int>::max() / 2;
+
+    const QSize size = viewport()->size();
+    const int w = static_cast<int>(min(MAX_RANGE, ceil(contentWidth())));
+    const int h = static_cast<int>(min(MAX_RANGE, ceil(contentHeight())));
+
+    horizontalScrollBar()->setRange(0, max(0, w - size.width()));
+    horizontalScrollBar()->setPageStep(size.width());
+    horizontalScrollBar()->setSingleStep(20);
+
+    verticalScrollBar()->setRange(0, max(0, h - size.height()));
+    verticalScrollBar()->setPageStep(size.height());
+    verticalScrollBar()->setSingleStep(max(1, static_cast<int>(m_unitHeight)));
+}
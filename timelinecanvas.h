@@ -0,0 +1,185 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include "taskmodel.h"
+#include "timelinedensity.h"
+#include "timelinetiles.h"
+
+#include <QAbstractScrollArea>
+#include <QColor>
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Paints the tasks of a TaskModel as bars on a time axis. The layout is
+// kept in flat arrays and only the rows and the time range intersecting
+// the viewport are painted, so the cost of a frame depends on what is
+// visible instead of on the task count.
+//
+// The content is rasterized into tiles on a thread pool. A frame only
+// blits the cached tiles, tiles which are not ready yet show a
+// placeholder until they arrive.
+class TimeLineCanvas : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    explicit TimeLineCanvas(QWidget *parent = nullptr);
+
+    void setModel(const TaskModelPtr &model);
+    void appendTasks(int firstNewId, const std::vector<int> &stoppedIds);
+
+    // pixel per microsecond and pixel per row
+    qreal unitWidth() const;
+    qreal unitHeight() const;
+    void setUnitSize(qreal unitWidth, qreal unitHeight);
+    // keep what is under anchor, in viewport coordinates, in place
+    void setUnitSize(qreal unitWidth, qreal unitHeight, const QPoint &anchor);
+
+    bool hideKthread() const;
+    void setHideKthread(bool hide);
+
+    // put tasks which do not overlap in time into the same row
+    bool packRows() const;
+    void setPackRows(bool pack);
+
+    // memory budget of the tile cache in KiB
+    int tileCacheSize() const;
+    void setTileCacheSize(int kilobytes);
+
+    int rowCount() const;
+    int64_t maxStopTime() const;
+
+    // the time range shown between viewport x 0 and contentRight()
+    int64_t visibleStartTime() const;
+    int64_t visibleStopTime() const;
+    // right end of the content in viewport coordinates, clamped to the viewport
+    int contentRight() const;
+
+    // the task drawn at pos in viewport coordinates, -1 if there is none
+    int taskAt(const QPoint &pos) const;
+    // scroll so that the task is in the center of the viewport
+    void centerOnTask(int id);
+
+signals:
+    void visibleRangeChanged();
+    // the wheel has been turned with Ctrl held, by steps of 1/8 degree
+    void zoomRequested(int angleDelta, const QPoint &anchor);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void changeEvent(QEvent *event) override;
+    bool viewportEvent(QEvent *event) override;
+
+private:
+    // generate bright color according to the hash of a comm
+    static QColor generateBrightColor(uint32_t hash);
+
+    static int64_t taskEnd(const Task &t);
+    static QString timeText(int64_t time);
+
+    QString toolTipText(int id) const;
+
+    // the color and the text width of the comm values new since the last
+    // call, the widths of the descriptions are summed from them
+    void updateComms();
+    qreal descriptionWidth(const Task &t) const;
+    qreal textMargin() const;
+
+    bool taskShouldShow(int id) const;
+    bool textShouldShow() const;
+
+    // rect is the area of the tile in content coordinates
+    void requestTile(const TimeLineTileKey &key);
+    void paintFallback(QPainter &painter, const QRegion &missing);
+    void collectTasks(const QRect &rect, TimeLineTileJob &job) const;
+    void collectDensity(int level, const QRect &rect, TimeLineTileJob &job) const;
+
+    void relayout();
+    void layoutTask(int id);
+    void setPackedRowEnd(int row, int64_t end);
+
+    // the task ids of a row, sorted by start time
+    const int *rowBegin(int row) const;
+    const int *rowEnd(int row) const;
+
+    qreal contentWidth() const;
+    qreal contentHeight() const;
+    void updateScrollBars();
+
+private:
+    typedef std::pair<int64_t, int> RowEnd;
+
+    TaskModelPtr m_model;
+
+    qreal m_unitWidth;
+    qreal m_unitHeight;
+    bool m_hideKthread;
+    bool m_packRows;
+
+    int64_t m_maxStopTime;
+    // by comm id, so every process of a program has the same color
+    std::vector<QRgb> m_commColor;
+    std::vector<qreal> m_commTextWidth;
+    qreal m_maxCommWidth;
+    qreal m_digitWidth;
+    qreal m_bracketWidth;
+    qreal m_livingWidth;
+    qreal m_startedBeforeWidth;
+
+    // row of each task, -1 when it is hidden
+    std::vector<int> m_taskRow;
+
+    // without packing every row holds exactly one task
+    std::vector<int> m_rowTask;
+
+    // with packing, the tasks of each row and the end of its last task
+    std::vector<std::vector<int>> m_packedRows;
+    std::vector<int64_t> m_packedRowEnd;
+    // rows by the end of their last task, entries are stale once the row grows
+    std::priority_queue<RowEnd, std::vector<RowEnd>, std::greater<RowEnd>> m_freeRows;
+    // summary of the packed rows used when zoomed out
+    TimeLineDensity m_density;
+
+    TimeLineTiles m_tiles;
+    // While the tiles of a new zoom are rendered, the tiles of the last
+    // zoom which was complete are scaled in their place.
+    bool m_tilesComplete;
+    qreal m_fallbackUnitWidth;
+    qreal m_fallbackUnitHeight;
+
+    bool m_dragging;
+    QPoint m_dragStartPos;
+    QPoint m_dragStartScroll;
+};
@@ -0,0 +1,160 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "timelinedensity.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <assert.h>
+
+using namespace std;
+
+namespace
+{
+
+const int64_t LIVING_END = numeric_limits<int64_t>::max();
+
+// 1 ms at level 0, every level merges gaps 4 times as wide
+const int64_t BASE_GAP = 1000;
+const int LEVEL_SHIFT = 2;
+
+}
+
+int64_t TimeLineDensity::levelGap(int level)
+{
+    assert(level >= 0 && level < LEVEL_COUNT);
+    return BASE_GAP << (LEVEL_SHIFT * level);
+}
+
+int TimeLineDensity::levelFor(double pixelTime)
+{
+    int result = -1;
+    for (int level = 0; level < LEVEL_COUNT && levelGap(level) <= pixelTime; level++)
+    {
+        result = level;
+    }
+    return result;
+}
+
+void TimeLineDensity::clear()
+{
+    m_rows.clear();
+}
+
+void TimeLineDensity::addRow()
+{
+    m_rows.emplace_back(1);
+}
+
+void TimeLineDensity::appendTask(int row, int id, int64_t start, int64_t end)
+{
+    std::vector<std::vector<Span>> &levels = m_rows[static_cast<size_t>(row)];
+
+    // a living task counts as busy once it stops
+    const int64_t duration = end == LIVING_END ? 0 : end - start;
+
+    for (size_t level = 0; level < levels.size(); level++)
+    {
+        append(levels[level], levelGap(static_cast<int>(level)), id, start, end, duration);
+
+        const size_t next = level + 1;
+        if (next == levels.size() && next < LEVEL_COUNT && levels[level].size() >= 2)
+        {
+            // the first time the levels differ, derive the next one
+            std::vector<Span> merged;
+            for (const Span &s : levels[level])
+            {
+                if (!merged.empty() && s.start - merged.back().stop <= levelGap(static_cast<int>(next)))
+                {
+                    Span &last = merged.back();
+                    last.stop = max(last.stop, s.stop);
+                    last.busy += s.busy;
+                    if (s.dominantDuration > last.dominantDuration)
+                    {
+                        last.dominantDuration = s.dominantDuration;
+                        last.dominantId = s.dominantId;
+                    }
+                }
+                else
+                {
+                    merged.push_back(s);
+                }
+            }
+            levels.push_back(merged);
+
+            // the task is in it already
+            break;
+        }
+    }
+}
+
+void TimeLineDensity::stopTask(int row, int id, int64_t start, int64_t stop)
+{
+    const int64_t duration = stop - start;
+
+    for (std::vector<Span> &spans : m_rows[static_cast<size_t>(row)])
+    {
+        assert(!spans.empty());
+
+        Span &last = spans.back();
+        last.stop = stop;
+        last.busy += duration;
+        if (duration > last.dominantDuration || last.dominantId == id)
+        {
+            last.dominantDuration = duration;
+            last.dominantId = id;
+        }
+    }
+}
+
+const std::vector<TimeLineDensity::Span> &TimeLineDensity::spans(int row, int level) const
+{
+    const std::vector<std::vector<Span>> &levels = m_rows[static_cast<size_t>(row)];
+    return levels[min(static_cast<size_t>(level), levels.size() - 1)];
+}
+
+void TimeLineDensity::append(std::vector<Span> &spans, int64_t gap, int id, int64_t start, int64_t end, int64_t duration)
+{
+    if (!spans.empty() && start - spans.back().stop <= gap)
+    {
+        Span &last = spans.back();
+        last.stop = max(last.stop, end);
+        last.busy += duration;
+        if (duration > last.dominantDuration)
+        {
+            last.dominantDuration = duration;
+            last.dominantId = id;
+        }
+        return;
+    }
+
+    Span s;
+    s.start = start;
+    s.stop = end;
+    s.busy = duration;
+    s.dominantDuration = duration;
+    s.dominantId = id;
+    spans.push_back(s);
+}
@@ -0,0 +1,82 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Multi-resolution summary of the rows of the timeline, like mipmaps.
+//
+// At level l the tasks of a row are merged into spans wherever the gap
+// between them is shorter than levelGap(l). A span remembers how much
+// of it is busy and which task covers most of it. When the gaps at the
+// current zoom are below one pixel, the spans of the matching level are
+// painted instead of every single task.
+//
+// Tasks have to be appended to a row in start time order, which is the
+// order the model creates them in, so the summary can grow with the
+// model instead of being rebuilt.
+class TimeLineDensity
+{
+public:
+    struct Span
+    {
+        int64_t start;
+        int64_t stop;
+        // sum of the durations of the tasks in the span
+        int64_t busy;
+        // the task with the longest duration in the span
+        int64_t dominantDuration;
+        int dominantId;
+    };
+
+    static const int LEVEL_COUNT = 10;
+
+    // the gap merged at a level, in microsecond
+    static int64_t levelGap(int level);
+    // the coarsest level whose gaps are no wider than pixelTime, -1 if
+    // even level 0 would merge visible gaps
+    static int levelFor(double pixelTime);
+
+    void clear();
+    void addRow();
+
+    // end is the stop time, or INT64_MAX for a living task
+    void appendTask(int row, int id, int64_t start, int64_t end);
+    // the last task of the row has stopped
+    void stopTask(int row, int id, int64_t start, int64_t stop);
+
+    // the spans of the row at the level, sorted by time
+    const std::vector<Span> &spans(int row, int level) const;
+
+private:
+    static void append(std::vector<Span> &spans, int64_t gap, int id, int64_t start, int64_t end, int64_t duration);
+
+private:
+    // per row, the levels computed so far. A level is only added once
+    // the one below has two spans, until then they are all the same.
+    std::vector<std::vector<std::vector<Span>>> m_rows;
+};
@@ -0,0 +1,211 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "timelinetiles.h"
+
+#include <QFutureWatcher>
+#include <QPainter>
+#include <QtConcurrent>
+#include <QtMath>
+
+namespace
+{
+
+const int DEFAULT_CACHE_SIZE = 64 * 1024;
+
+int imageCost(const QImage &image)
+{
+    return qMax(1, image.bytesPerLine() * image.height() / 1024);
+}
+
+uint hashCombine(uint seed, uint h)
+{
+    return seed ^ (h + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+}
+
+bool operator==(const TimeLineTileKey &a, const TimeLineTileKey &b)
+{
+    return a.x == b.x && a.y == b.y && a.unitWidth == b.unitWidth && a.unitHeight == b.unitHeight;
+}
+
+uint qHash(const TimeLineTileKey &key, uint seed)
+{
+    seed = hashCombine(seed, qHash(key.unitWidth));
+    seed = hashCombine(seed, qHash(key.unitHeight));
+    seed = hashCombine(seed, qHash(key.x));
+    seed = hashCombine(seed, qHash(key.y));
+    return seed;
+}
+
+TimeLineTiles::TimeLineTiles(QObject *parent)
+    : QObject(parent)
+    , m_cache(DEFAULT_CACHE_SIZE)
+    , m_wanted(std::make_shared<Wanted>())
+    , m_generation(0)
+    , m_clearedGeneration(0)
+{
+}
+
+TimeLineTiles::~TimeLineTiles()
+{
+    // the jobs only share the wanted set with us, but their watchers are ours
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+int TimeLineTiles::cacheSize() const
+{
+    return m_cache.maxCost();
+}
+
+void TimeLineTiles::setCacheSize(int kilobytes)
+{
+    m_cache.setMaxCost(kilobytes);
+}
+
+void TimeLineTiles::clear()
+{
+    m_cache.clear();
+    m_pending.clear();
+    m_generation++;
+    m_clearedGeneration = m_generation;
+}
+
+void TimeLineTiles::invalidate()
+{
+    m_generation++;
+}
+
+const QImage *TimeLineTiles::tile(const TimeLineTileKey &key, bool *stale) const
+{
+    const Tile *t = m_cache.object(key);
+    if (!t)
+    {
+        return nullptr;
+    }
+
+    if (stale)
+    {
+        *stale = t->generation != m_generation;
+    }
+    return &t->image;
+}
+
+bool TimeLineTiles::needsRender(const TimeLineTileKey &key) const
+{
+    const Tile *t = m_cache.object(key);
+    if (t && t->generation == m_generation)
+    {
+        return false;
+    }
+
+    auto it = m_pending.constFind(key);
+    return it == m_pending.constEnd() || it.value() != m_generation;
+}
+
+void TimeLineTiles::render(const std::shared_ptr<const TimeLineTileJob> &job)
+{
+    const TimeLineTileKey key = job->key;
+    const quint64 generation = m_generation;
+    m_pending.insert(key, generation);
+
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, key, generation]() {
+        onRendered(key, generation, watcher->result());
+        watcher->deleteLater();
+    });
+
+    std::shared_ptr<Wanted> wanted = m_wanted;
+    watcher->setFuture(QtConcurrent::run(&m_pool, [job, wanted]() {
+        return paint(job, wanted);
+    }));
+}
+
+void TimeLineTiles::setWanted(const QSet<TimeLineTileKey> &keys)
+{
+    QMutexLocker locker(&m_wanted->mutex);
+    m_wanted->keys = keys;
+}
+
+QImage TimeLineTiles::paint(const std::shared_ptr<const TimeLineTileJob> &job, const std::shared_ptr<Wanted> &wanted)
+{
+    {
+        QMutexLocker locker(&wanted->mutex);
+        if (!wanted->keys.contains(job->key))
+        {
+            return QImage();
+        }
+    }
+
+    const int size = qCeil(TILE_SIZE * job->devicePixelRatio);
+    QImage image(size, size, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(job->devicePixelRatio);
+    image.fill(job->background);
+
+    QPainter painter(&image);
+    painter.setFont(job->font);
+    painter.setPen(job->textColor);
+
+    for (const TimeLineTileJob::Item &item : job->items)
+    {
+        painter.fillRect(item.rect, QColor::fromRgba(item.color));
+        if (!item.text.isEmpty())
+        {
+            painter.drawText(item.rect.adjusted(job->textPadding, 0, 0, 0), job->textFlags, item.text);
+        }
+    }
+
+    return image;
+}
+
+void TimeLineTiles::onRendered(const TimeLineTileKey &key, quint64 generation, const QImage &image)
+{
+    auto it = m_pending.find(key);
+    if (it != m_pending.end() && it.value() == generation)
+    {
+        m_pending.erase(it);
+    }
+
+    // skipped, or rendered for content which has been cleared since
+    if (image.isNull() || generation < m_clearedGeneration)
+    {
+        return;
+    }
+
+    // do not replace a newer tile by an older one
+    const Tile *cached = m_cache.object(key);
+    if (cached && cached->generation > generation)
+    {
+        return;
+    }
+
+    Tile *t = new Tile;
+    t->image = image;
+    t->generation = generation;
+    m_cache.insert(key, t, imageCost(image));
+
+    emit tileReady();
+}
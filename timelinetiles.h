@@ -0,0 +1,136 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2020 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QCache>
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+#include <memory>
+#include <vector>
+
+// A tile of the timeline, x and y count TILE_SIZE content pixels at the
+// zoom given by the unit size
+struct TimeLineTileKey
+{
+    qreal unitWidth;
+    qreal unitHeight;
+    int x;
+    int y;
+};
+
+bool operator==(const TimeLineTileKey &a, const TimeLineTileKey &b);
+uint qHash(const TimeLineTileKey &key, uint seed = 0);
+
+// Everything needed to paint a tile, in tile coordinates. It is collected
+// on the GUI thread, so the workers never touch the model or the layout.
+struct TimeLineTileJob
+{
+    struct Item
+    {
+        QRectF rect;
+        QRgb color;
+        // empty if the text is not shown
+        QString text;
+    };
+
+    TimeLineTileKey key;
+    QFont font;
+    QColor textColor;
+    QColor background;
+    int textFlags;
+    qreal textPadding;
+    qreal devicePixelRatio;
+    std::vector<Item> items;
+};
+
+// Renders tiles on a thread pool and keeps them in a LRU cache limited
+// by memory. Tiles become stale when the content changes; a stale tile
+// can still be shown until the new one is ready.
+class TimeLineTiles : public QObject
+{
+    Q_OBJECT
+public:
+    static const int TILE_SIZE = 256;
+
+    explicit TimeLineTiles(QObject *parent = nullptr);
+    ~TimeLineTiles() override;
+
+    // memory budget of the cache in KiB
+    int cacheSize() const;
+    void setCacheSize(int kilobytes);
+
+    // drop every tile, including the ones being rendered
+    void clear();
+    // the content has changed, every tile rendered so far is stale
+    void invalidate();
+
+    // nullptr if the tile is not cached
+    const QImage *tile(const TimeLineTileKey &key, bool *stale = nullptr) const;
+    // neither cached nor being rendered for the current content
+    bool needsRender(const TimeLineTileKey &key) const;
+    void render(const std::shared_ptr<const TimeLineTileJob> &job);
+
+    // jobs of tiles which are not wanted anymore are skipped if they
+    // have not started yet, so a fast scroll does not queue up work
+    void setWanted(const QSet<TimeLineTileKey> &keys);
+
+signals:
+    void tileReady();
+
+private:
+    struct Tile
+    {
+        QImage image;
+        quint64 generation;
+    };
+
+    struct Wanted
+    {
+        QMutex mutex;
+        QSet<TimeLineTileKey> keys;
+    };
+
+    static QImage paint(const std::shared_ptr<const TimeLineTileJob> &job, const std::shared_ptr<Wanted> &wanted);
+    void onRendered(const TimeLineTileKey &key, quint64 generation, const QImage &image);
+
+private:
+    QCache<TimeLineTileKey, Tile> m_cache;
+    // the generation each pending tile is rendered for
+    QHash<TimeLineTileKey, quint64> m_pending;
+    std::shared_ptr<Wanted> m_wanted;
+
+    quint64 m_generation;
+    // results older than this belong to content which is gone
+    quint64 m_clearedGeneration;
+
+    QThreadPool m_pool;
+};
@@ -27,8 +27,6 @@
 #include "taskmodel.h"
 
 #include <QWidget>
-#include <QGraphicsScene>
-#include <QGraphicsItem>
 
 #include <vector>
 
@@ -44,7 +42,15 @@ public:
     explicit TimeLineWidget(QWidget *parent = nullptr);
     ~TimeLineWidget() override;
 
-    void setModel(const TaskModel &model);
+    void setModel(const TaskModelPtr &model);
+
+    // The model has been extended in place: add the tasks from firstNewId
+    // on and update the tasks whose stop time has been set. Nothing else
+    // is laid out again.
+    void appendTasks(int firstNewId, const std::vector<int> &stoppedIds);
+
+    // memory budget of the rendered tiles in KiB
+    void setTileCacheSize(int kilobytes);
 
 protected:
     void resizeEvent(QResizeEvent *event) override;
@@ -56,33 +62,13 @@ private slots:
 private:
     void initConnection();
 
-    // generate bright color according to the description of a task
-    static QColor generateBrightColor(const QByteArray &ba);
-    static QColor itemColor(const Task &t);
-
-    QPointF scenePointOnViewCenter() const;
-
-    int centerTask() const;
-    void centerOnTask(int i);
-
     qreal unitWidth() const;
     qreal unitHeight() const;
 
-    bool taskShouldShow(int i) const;
-    bool textShouldShow() const;
-
-    void clearScene();
-    void initItems();
-    void redrawScene();
-
+    void updateUnitSize();
+    void zoom(int angleDelta, const QPoint &anchor);
     void updateRuler();
 
 private:
     Ui::TimeLineWidget *ui;
-    QGraphicsScene *m_scene;
-    TaskModel m_model;
-    int64_t m_maxStopTime;
-    std::vector<QGraphicsRectItem *> m_rects;
-    std::vector<QGraphicsTextItem *> m_texts;
 };
-